@@ -4,11 +4,16 @@ set -xue
 # QEMU file path
 QEMU=qemu-system-riscv32
 QEMU_SMP=4
+QEMU_CPU="rv32,v=true" # V lets the data-path kernels in src/common/datapath.h use RVV, "rv32" runs the scalar ones
 
 CC=$(which riscv64-unknown-elf-gcc)
 CPP=$(which riscv64-unknown-elf-g++)
 CFLAGS="-march=rv32imac_zicsr -mabi=ilp32 -std=c99 -nostdlib -nostdinc -g3 -O3 -Wall -Werror -fno-builtin -ffixed-tp"
 CCFLAGS="-march=rv32imac_zicsr -mabi=ilp32 -std=c++20 -nostdlib -nostdinc -g3 -O3 -Wall -Werror -fno-builtin -fno-exceptions -fno-rtti -ffreestanding -ffixed-tp"
+# LOCKSTAT=1 ./run.sh builds in per-lock contention statistics, see src/sync/lockstat.h
+if [ "${LOCKSTAT:-0}" = "1" ]; then
+    CCFLAGS="$CCFLAGS -DCONFIG_LOCKSTAT"
+fi
 CDIR=src
 ODIR=build
 
@@ -65,7 +70,7 @@ $CPP $CCFLAGS -Wl,-T$CDIR/kernel.ld -Wl,-Map=$ODIR/kernel.map $OBJ_FILES -o $ODI
 DISK_IMAGE=fat32.img
 
 # Run QEMU
-$QEMU -machine virt -bios default -nographic -serial mon:stdio --no-reboot -smp $QEMU_SMP \
+$QEMU -machine virt -bios default -nographic -serial mon:stdio --no-reboot -smp $QEMU_SMP -cpu $QEMU_CPU \
     -drive id=drive0,file=$DISK_IMAGE,format=raw,if=none \
     -device virtio-blk-device,drive=drive0,bus=virtio-mmio-bus.0 \
     -kernel $ODIR/kernel.elf
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "arena.h"
+
+Arena::Arena(size_t chunk_size) : finalizers(nullptr), chunk_size(chunk_size), owns_first(true) {
+    first = new_chunk(chunk_size);
+    current = first;
+}
+
+Arena::Arena(void* buffer, size_t size) : finalizers(nullptr), chunk_size(size), owns_first(false) {
+    ASSERT(size > sizeof(Chunk));
+    first = (Chunk*)buffer;
+    first->next = nullptr;
+    first->size = size - sizeof(Chunk);
+    first->used = 0;
+    current = first;
+}
+
+Arena::~Arena() {
+    reset();
+    if (owns_first) {
+        heap::free(first);
+    }
+}
+
+Arena::Chunk* Arena::new_chunk(size_t min_size) {
+    size_t size = min_size > chunk_size ? min_size : chunk_size;
+    Chunk* chunk = (Chunk*)heap::malloc(sizeof(Chunk) + size);
+    if (chunk == nullptr) {
+        PANIC("out of memory for arena chunk");
+    }
+    chunk->next = nullptr;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void Arena::free_chunks_after(Chunk* chunk) {
+    Chunk* next = chunk->next;
+    chunk->next = nullptr;
+    while (next != nullptr) {
+        Chunk* after = next->next;
+        heap::free(next);
+        next = after;
+    }
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    // Alignment is by address, so a chunk's own alignment doesn't matter
+    uintptr_t base = (uintptr_t)(current + 1);
+    uintptr_t start = (base + current->used + align - 1) & ~(uintptr_t)(align - 1);
+    if (start + size > base + current->size) {
+        // Worst-case padding so the fresh chunk always fits
+        Chunk* chunk = new_chunk(size + align);
+        current->next = chunk;
+        current = chunk;
+        base = (uintptr_t)(current + 1);
+        start = (base + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    current->used = start + size - base;
+    return (void*)start;
+}
+
+Arena::Mark Arena::mark() const {
+    return Mark{current, current->used, finalizers};
+}
+
+void Arena::release(const Mark& m) {
+    while (finalizers != m.finalizers) {
+        Finalizer* fin = finalizers;
+        finalizers = fin->next;
+        fin->destroy(fin->obj);
+    }
+    free_chunks_after(m.chunk);
+    current = m.chunk;
+    current->used = m.used;
+}
+
+void Arena::reset() {
+    release(Mark{first, 0, nullptr});
+}
+
+size_t Arena::used() const {
+    size_t total = 0;
+    for (Chunk* chunk = first; chunk != nullptr; chunk = chunk->next) {
+        total += chunk->used;
+    }
+    return total;
+}
\ No newline at end of file
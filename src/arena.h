@@ -0,0 +1,102 @@
+#pragma once
+
+#include "common/common.h"
+#include "common/utility.h"
+#include "heap.h"
+
+// Bump-pointer region allocator for objects that all die together, such as everything one I/O request
+// allocates. allocate() only moves a pointer, and reset() or release() frees everything allocated
+// since in one step, running the destructors of objects created with make() in reverse order
+// An Arena is owned by one thread at a time, it takes no locks
+class Arena {
+    struct Chunk {
+        Chunk* next;
+        size_t size; // Usable bytes after the header
+        size_t used;
+    };
+
+    // Destructor to run on reset, allocated in the arena next to its object
+    struct Finalizer {
+        Finalizer* next;
+        void (*destroy)(void* obj);
+        void* obj;
+    };
+
+    Chunk* first;
+    Chunk* current;
+    Finalizer* finalizers; // Most recent first
+    size_t chunk_size;
+    bool owns_first; // False when the first chunk lives in a caller's buffer
+
+    Chunk* new_chunk(size_t min_size);
+    void free_chunks_after(Chunk* chunk);
+
+    template <typename T>
+    static void destroy(void* obj) {
+        ((T*)obj)->~T();
+    }
+
+public:
+    static constexpr size_t DEFAULT_ALIGN = 16;
+
+    // Position to rewind to with release()
+    struct Mark {
+        Chunk* chunk;
+        size_t used;
+        Finalizer* finalizers;
+    };
+
+    // Chunks of chunk_size bytes come from the heap as needed, the first one right away
+    Arena(size_t chunk_size = 4096);
+    // The first chunk is buffer, which must outlive the arena, later ones come from the heap
+    Arena(void* buffer, size_t size);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * Returns size bytes aligned to align, a power of two, never nullptr
+     * Nothing allocated with it is destroyed, only its memory is reclaimed
+     */
+    void* allocate(size_t size, size_t align = DEFAULT_ALIGN);
+
+    /**
+     * Constructs a T in the arena, its destructor runs when the arena is reset or released past it
+     */
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* obj = new (allocate(sizeof(T), alignof(T) > DEFAULT_ALIGN ? alignof(T) : DEFAULT_ALIGN))
+            T(util::forward<Args>(args)...);
+        if constexpr (!__has_trivial_destructor(T)) {
+            Finalizer* fin = (Finalizer*)allocate(sizeof(Finalizer), alignof(Finalizer));
+            fin->next = finalizers;
+            fin->destroy = destroy<T>;
+            fin->obj = obj;
+            finalizers = fin;
+        }
+        return obj;
+    }
+
+    Mark mark() const;
+    // Destroys and frees everything allocated since m, later marks become invalid
+    void release(const Mark& m);
+    // Destroys and frees everything, keeping only the first chunk
+    void reset();
+    // Bytes handed out since the last reset, including alignment padding
+    size_t used() const;
+};
+
+// Releases everything allocated in arena during its lifetime
+class ArenaScope {
+    Arena& arena;
+    Arena::Mark start;
+public:
+    ArenaScope(Arena& arena) : arena(arena), start(arena.mark()) {}
+    ~ArenaScope() {
+        arena.release(start);
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
\ No newline at end of file
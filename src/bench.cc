@@ -0,0 +1,606 @@
+#include "bench.h"
+#include "sync/mpmc_queue.h"
+#include "sync/concurrent_map.h"
+#include "sync/pool.h"
+#include "sync/rcu.h"
+#include "sync/channel.h"
+#include "sync/wait_group.h"
+#include "sync/syncmap.h"
+#include "sync/sync_queue.h"
+#include "sync/shared.h"
+#include "sync/spinlock.h"
+#include "sync/promise.h"
+#include "pallocator.h"
+#include "common/datapath.h"
+#include "drivers/virtio-blk/virtio-blk.h"
+
+namespace bench {
+
+    constexpr uint32_t QUEUE_OPS = 10000;
+
+    // Push/pop throughput of MPMCQueue against SyncQueue with 1 to 8 kthreads
+    void mpmc_queue() {
+        printf("bench: mpmc_queue, %d push+pop pairs per thread\n", QUEUE_OPS);
+        for (uint32_t n = 1; n <= 8; n *= 2) {
+            MPMCQueue<int*, 1024>* ring = new MPMCQueue<int*, 1024>();
+            uint64_t ring_ticks = run_parallel(n, [ring](uint32_t id) {
+                int token = id;
+                int* item = nullptr;
+                for (uint32_t i = 0; i < QUEUE_OPS; i++) {
+                    while (!ring->try_push(&token)) {}
+                    while (!ring->try_pop(item)) {}
+                }
+            });
+
+            SyncQueue<int>* queue = new SyncQueue<int>();
+            uint64_t queue_ticks = run_parallel(n, [queue](uint32_t id) {
+                int token = id;
+                for (uint32_t i = 0; i < QUEUE_OPS; i++) {
+                    queue->push(&token);
+                    while (queue->pop() == nullptr) {}
+                }
+            });
+
+            printf("bench: %d threads: MPMCQueue %d ticks, SyncQueue %d ticks\n",
+                   n, (uint32_t)ring_ticks, (uint32_t)queue_ticks);
+            delete ring;
+            delete queue;
+        }
+    }
+
+    constexpr uint32_t ATOMIC_OPS = 100000;
+
+    struct Counted : RefCounted {
+        int val = 0;
+    };
+
+    // Single-thread cost of the atomic operations on the refcount and lock hot paths
+    void atomics() {
+        printf("bench: atomics, %d operations each\n", ATOMIC_OPS);
+        Atomic<uint32_t> word(0);
+        Atomic<uint64_t> dword(0);
+        uint32_t sink = 0;
+
+        uint64_t start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) sink += word.get(MemoryOrder::RELAXED);
+        uint64_t relaxed_load = pit::get_time() - start;
+
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) sink += word.get();
+        uint64_t seq_cst_load = pit::get_time() - start;
+
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) word.fetch_add(1, MemoryOrder::RELAXED);
+        uint64_t relaxed_add = pit::get_time() - start;
+
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) word.fetch_add(1);
+        uint64_t seq_cst_add = pit::get_time() - start;
+
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) dword.fetch_add(1);
+        uint64_t add_64 = pit::get_time() - start;
+
+        Spinlock lock;
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) {
+            lock.lock();
+            lock.unlock();
+        }
+        uint64_t spinlock = pit::get_time() - start;
+
+        SharedPtr<int> shared = make_shared<int>(0);
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) {
+            SharedPtr<int> copy = shared;
+        }
+        uint64_t shared_copy = pit::get_time() - start;
+
+        // Moving hands the reference over without touching the counts
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) {
+            SharedPtr<int> moved = util::move(shared);
+            shared = util::move(moved);
+        }
+        uint64_t shared_move = pit::get_time() - start;
+
+        RefPtr<Counted> ref = make_ref<Counted>();
+        start = pit::get_time();
+        for (uint32_t i = 0; i < ATOMIC_OPS; i++) {
+            RefPtr<Counted> copy = ref;
+        }
+        uint64_t ref_copy = pit::get_time() - start;
+
+        ASSERT(dword.get() == ATOMIC_OPS);
+        printf("bench: load relaxed %d, seq_cst %d ticks\n", (uint32_t)relaxed_load, (uint32_t)seq_cst_load);
+        printf("bench: fetch_add relaxed %d, seq_cst %d, 64-bit %d ticks\n",
+               (uint32_t)relaxed_add, (uint32_t)seq_cst_add, (uint32_t)add_64);
+        printf("bench: spinlock %d, SharedPtr copy %d, move %d, RefPtr copy %d ticks (sink %d)\n",
+               (uint32_t)spinlock, (uint32_t)shared_copy, (uint32_t)shared_move, (uint32_t)ref_copy, sink);
+    }
+
+    constexpr uint32_t BARRIER_PHASES = 200;
+
+    template <typename B>
+    static uint32_t barrier_phases_per_second(uint32_t n) {
+        B* barrier = new B(n);
+        uint64_t ticks = run_parallel(n, [barrier](uint32_t id) {
+            for (uint32_t i = 0; i < BARRIER_PHASES; i++) {
+                barrier->sync();
+            }
+        });
+        delete barrier;
+        return (uint32_t)(BARRIER_PHASES * TIMEBASE_HZ / (ticks == 0 ? 1 : ticks));
+    }
+
+    // Phases per second of each barrier as the number of participants grows
+    void barriers() {
+        printf("bench: barriers, %d phases\n", BARRIER_PHASES);
+        for (uint32_t n = 1; n <= 32; n *= 2) {
+            printf("bench: %d threads: Barrier %d/s, SenseBarrier %d/s, TreeBarrier %d/s\n", n,
+                   barrier_phases_per_second<Barrier>(n),
+                   barrier_phases_per_second<SenseBarrier>(n),
+                   barrier_phases_per_second<TreeBarrier>(n));
+        }
+    }
+
+    constexpr uint32_t FANOUT_SECTORS = 64;
+
+    // Issues 64 sector reads from one thread and waits once for all of them with when_all
+    // read_write_disk still polls the device and sets its promise before returning, so the reads run
+    // one after another and this measures serial polling plus the promise overhead, not overlapped I/O
+    void disk_fanout() {
+        char* bufs = new char[FANOUT_SECTORS * 512];
+        SharedPtr<Promise<bool>>* reads = new SharedPtr<Promise<bool>>[FANOUT_SECTORS];
+        uint64_t start = pit::get_time();
+        for (uint32_t i = 0; i < FANOUT_SECTORS; i++) {
+            reads[i] = read_write_disk(&bufs[i * 512], i, false);
+        }
+        bool ok = when_all(reads, FANOUT_SECTORS)->get();
+        uint64_t ticks = pit::get_time() - start;
+        printf("bench: disk_fanout, %d sectors in %d ticks, ok = %d\n", FANOUT_SECTORS, (uint32_t)ticks, ok);
+        delete[] reads;
+        delete[] bufs;
+    }
+
+    constexpr uint32_t MAP_OPS = 10000;
+    constexpr uint32_t MAP_KEYS = 256;
+
+    // Mixed workload on a shared map: 80% get, 10% put, 10% remove over MAP_KEYS keys
+    template <typename Map>
+    uint64_t map_ticks(Map* map, uint32_t n) {
+        for (uint32_t k = 0; k < MAP_KEYS; k += 2) {
+            map->put(k, k);
+        }
+        return run_parallel(n, [map](uint32_t id) {
+            uint32_t x = id * 2654435761u + 1;
+            for (uint32_t i = 0; i < MAP_OPS; i++) {
+                x ^= x << 13; // xorshift32
+                x ^= x >> 17;
+                x ^= x << 5;
+                uint32_t key = x % MAP_KEYS;
+                uint32_t op = (x >> 16) % 10;
+                if (op == 0) {
+                    map->put(key, i);
+                } else if (op == 1) {
+                    map->remove(key);
+                } else {
+                    map->contains(key);
+                }
+            }
+        });
+    }
+
+    // Adapts SyncMap to the benchmark, its get panics on a missing key
+    struct SyncMapBench {
+        SyncMap<uint32_t, uint32_t> map;
+        SyncMapBench() : map(MAP_KEYS) {}
+        void put(uint32_t key, uint32_t value) {
+            map.put(key, value);
+        }
+        void remove(uint32_t key) {
+            map.remove(key);
+        }
+        void contains(uint32_t key) {
+            map.contains(key);
+        }
+    };
+
+    // Mixed get/put/remove throughput of ConcurrentMap against SyncMap with 1 to 16 kthreads
+    void concurrent_map() {
+        printf("bench: concurrent_map, %d operations per thread\n", MAP_OPS);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            ConcurrentMap<uint32_t, uint32_t>* striped = new ConcurrentMap<uint32_t, uint32_t>(MAP_KEYS);
+            uint64_t striped_ticks = map_ticks(striped, n);
+            SyncMapBench* locked = new SyncMapBench();
+            uint64_t locked_ticks = map_ticks(locked, n);
+            printf("bench: %d threads: ConcurrentMap %d ticks, SyncMap %d ticks\n",
+                   n, (uint32_t)striped_ticks, (uint32_t)locked_ticks);
+            delete striped;
+            delete locked;
+        }
+    }
+
+    constexpr uint32_t POOL_OPS = 10000;
+    constexpr uint32_t POOL_BATCH = 8;
+
+    struct PoolObject {
+        uint8_t bytes[64];
+    };
+
+    // Allocate/free throughput of Pool's magazines against the heap with 1 to 16 kthreads
+    void pool() {
+        printf("bench: pool, %d batches of %d objects per thread\n", POOL_OPS, POOL_BATCH);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            Pool<PoolObject>* objects = new Pool<PoolObject>();
+            for (uint32_t i = 0; i < n * POOL_BATCH; i++) {
+                objects->free(new PoolObject());
+            }
+            objects->flush();
+            uint64_t pool_ticks = run_parallel(n, [objects](uint32_t id) {
+                PoolObject* batch[POOL_BATCH];
+                for (uint32_t i = 0; i < POOL_OPS; i++) {
+                    for (uint32_t j = 0; j < POOL_BATCH; j++) {
+                        batch[j] = objects->allocate();
+                    }
+                    for (uint32_t j = 0; j < POOL_BATCH; j++) {
+                        objects->free(batch[j]);
+                    }
+                }
+                objects->flush();
+            });
+
+            uint64_t heap_ticks = run_parallel(n, [](uint32_t id) {
+                PoolObject* batch[POOL_BATCH];
+                for (uint32_t i = 0; i < POOL_OPS; i++) {
+                    for (uint32_t j = 0; j < POOL_BATCH; j++) {
+                        batch[j] = new PoolObject();
+                    }
+                    for (uint32_t j = 0; j < POOL_BATCH; j++) {
+                        delete batch[j];
+                    }
+                }
+            });
+
+            printf("bench: %d threads: Pool %d ticks, heap %d ticks\n",
+                   n, (uint32_t)pool_ticks, (uint32_t)heap_ticks);
+        }
+    }
+
+    constexpr uint32_t RCU_OPS = 10000;
+
+    // Read-mostly workload, 1 update per 100 lookups, on MAP_KEYS keys
+    template <typename Map>
+    uint64_t read_mostly_ticks(Map* map, uint32_t n) {
+        for (uint32_t k = 0; k < MAP_KEYS; k++) {
+            map->put(k, k);
+        }
+        return run_parallel(n, [map](uint32_t id) {
+            uint32_t x = id * 2654435761u + 1;
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < RCU_OPS; i++) {
+                x ^= x << 13; // xorshift32
+                x ^= x >> 17;
+                x ^= x << 5;
+                uint32_t key = x % MAP_KEYS;
+                if ((x >> 16) % 100 == 0) {
+                    map->put(key, i);
+                } else {
+                    map->find(key, value);
+                }
+            }
+        });
+    }
+
+    // Lookup throughput of RCUHashMap against ConcurrentMap with 1 to 16 kthreads
+    void rcu_map() {
+        printf("bench: rcu_map, %d operations per thread\n", RCU_OPS);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            RCUHashMap<uint32_t, uint32_t>* rcu_map = new RCUHashMap<uint32_t, uint32_t>(MAP_KEYS);
+            uint64_t rcu_ticks = read_mostly_ticks(rcu_map, n);
+            ConcurrentMap<uint32_t, uint32_t>* striped = new ConcurrentMap<uint32_t, uint32_t>(MAP_KEYS);
+            uint64_t striped_ticks = read_mostly_ticks(striped, n);
+            printf("bench: %d threads: RCUHashMap %d ticks, ConcurrentMap %d ticks\n",
+                   n, (uint32_t)rcu_ticks, (uint32_t)striped_ticks);
+            delete rcu_map;
+            delete striped;
+        }
+    }
+
+    constexpr uint32_t COUNTER_OPS = 100000;
+
+    // Shared statistics counter: PerCPUCounter against one Atomic with 1 to 16 kthreads
+    void counters() {
+        printf("bench: counters, %d increments per thread\n", COUNTER_OPS);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            smp::PerCPUCounter* sloppy = new smp::PerCPUCounter();
+            uint64_t sloppy_ticks = run_parallel(n, [sloppy](uint32_t id) {
+                for (uint32_t i = 0; i < COUNTER_OPS; i++) {
+                    sloppy->add();
+                }
+            });
+
+            Atomic<uint32_t>* shared = new Atomic<uint32_t>(0);
+            uint64_t shared_ticks = run_parallel(n, [shared](uint32_t id) {
+                for (uint32_t i = 0; i < COUNTER_OPS; i++) {
+                    shared->fetch_add(1, MemoryOrder::RELAXED);
+                }
+            });
+
+            ASSERT(sloppy->sum() == (int64_t)n * COUNTER_OPS);
+            printf("bench: %d threads: PerCPUCounter %d ticks, Atomic %d ticks\n",
+                   n, (uint32_t)sloppy_ticks, (uint32_t)shared_ticks);
+            delete sloppy;
+            delete shared;
+        }
+    }
+
+    constexpr uint32_t PIPELINE_ITEMS = 10000;
+    constexpr uint32_t PIPELINE_DEPTH = 16;
+
+    // Three-stage pipeline: two producers, a stage that selects over both and transforms, and a sink
+    // Reports items per second through the whole pipeline
+    void pipeline() {
+        printf("bench: pipeline, %d items\n", PIPELINE_ITEMS);
+        Channel<uint32_t, PIPELINE_DEPTH>* sources[2] = {
+            new Channel<uint32_t, PIPELINE_DEPTH>(),
+            new Channel<uint32_t, PIPELINE_DEPTH>()
+        };
+        Channel<uint32_t, PIPELINE_DEPTH>* results = new Channel<uint32_t, PIPELINE_DEPTH>();
+        SharedPtr<WaitGroup> done = make_shared<WaitGroup>(4);
+
+        uint64_t start = pit::get_time();
+        for (uint32_t p = 0; p < 2; p++) {
+            Channel<uint32_t, PIPELINE_DEPTH>* source = sources[p];
+            threads::kthread([source, done, p]() mutable {
+                for (uint32_t i = p; i < PIPELINE_ITEMS; i += 2) {
+                    source->send(i);
+                }
+                source->close();
+                done->done();
+            });
+        }
+        threads::kthread([sources, results, done]() mutable {
+            uint32_t item;
+            while (select(sources, 2, item) >= 0) {
+                results->send(item * 2);
+            }
+            results->close();
+            done->done();
+        });
+        uint32_t total = 0;
+        threads::kthread([results, done, &total]() mutable {
+            uint32_t item;
+            while (results->recv(item)) {
+                total += item;
+            }
+            done->done();
+        });
+        done->wait();
+        uint64_t ticks = pit::get_time() - start;
+
+        ASSERT(total == PIPELINE_ITEMS * (PIPELINE_ITEMS - 1));
+        uint32_t per_second = ticks == 0 ? 0 : (uint32_t)((uint64_t)PIPELINE_ITEMS * TIMEBASE_HZ / ticks);
+        printf("bench: pipeline %d ticks, %d items/s\n", (uint32_t)ticks, per_second);
+        delete sources[0];
+        delete sources[1];
+        delete results;
+    }
+
+    constexpr uint32_t FORK_JOIN_ROUNDS = 100;
+
+    // Fork n empty kthreads and wait for all of them, with a Barrier(n + 1) against a WaitGroup
+    void fork_join() {
+        printf("bench: fork_join, %d rounds\n", FORK_JOIN_ROUNDS);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            uint64_t start = pit::get_time();
+            for (uint32_t r = 0; r < FORK_JOIN_ROUNDS; r++) {
+                SharedPtr<Barrier> barrier = make_shared<Barrier>(n + 1);
+                for (uint32_t i = 0; i < n; i++) {
+                    threads::kthread([barrier]() mutable {
+                        barrier->sync();
+                    });
+                }
+                barrier->sync();
+            }
+            uint64_t barrier_ticks = pit::get_time() - start;
+
+            start = pit::get_time();
+            SharedPtr<WaitGroup> group = make_shared<WaitGroup>();
+            for (uint32_t r = 0; r < FORK_JOIN_ROUNDS; r++) {
+                group->add(n);
+                for (uint32_t i = 0; i < n; i++) {
+                    threads::kthread([group]() mutable {
+                        group->done();
+                    });
+                }
+                group->wait();
+            }
+            uint64_t group_ticks = pit::get_time() - start;
+
+            printf("bench: %d threads: Barrier %d ticks, WaitGroup %d ticks\n",
+                   n, (uint32_t)barrier_ticks, (uint32_t)group_ticks);
+        }
+    }
+
+    constexpr uint32_t SLAB_OPS = 10000;
+    constexpr uint32_t SLAB_BATCH = 8;
+    constexpr uint32_t SLAB_SIZES[SLAB_BATCH] = {16, 24, 40, 64, 100, 200, 512, 1000};
+    constexpr uint32_t LARGE_SIZE = 2048; // Above slab::MAX_SIZE, so it takes the first-fit path
+
+    // malloc/free throughput of the slab size classes against the first-fit heap with 1 to 16 kthreads
+    void slab() {
+        printf("bench: slab, %d batches of %d allocations per thread\n", SLAB_OPS, SLAB_BATCH);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            uint64_t slab_ticks = run_parallel(n, [](uint32_t id) {
+                void* batch[SLAB_BATCH];
+                for (uint32_t i = 0; i < SLAB_OPS; i++) {
+                    for (uint32_t j = 0; j < SLAB_BATCH; j++) {
+                        batch[j] = heap::malloc(SLAB_SIZES[j]);
+                    }
+                    for (uint32_t j = 0; j < SLAB_BATCH; j++) {
+                        heap::free(batch[j]);
+                    }
+                }
+            });
+
+            uint64_t large_ticks = run_parallel(n, [](uint32_t id) {
+                void* batch[SLAB_BATCH];
+                for (uint32_t i = 0; i < SLAB_OPS; i++) {
+                    for (uint32_t j = 0; j < SLAB_BATCH; j++) {
+                        batch[j] = heap::malloc(LARGE_SIZE);
+                    }
+                    for (uint32_t j = 0; j < SLAB_BATCH; j++) {
+                        heap::free(batch[j]);
+                    }
+                }
+            });
+
+            uint64_t ops = (uint64_t)n * SLAB_OPS * SLAB_BATCH;
+            printf("bench: %d threads: slab %d ticks (%d ops/s), first-fit %d ticks (%d ops/s)\n",
+                   n, (uint32_t)slab_ticks, (uint32_t)(ops * TIMEBASE_HZ / (slab_ticks + 1)),
+                   (uint32_t)large_ticks, (uint32_t)(ops * TIMEBASE_HZ / (large_ticks + 1)));
+        }
+    }
+
+    constexpr uint32_t PAGE_OPS = 10000;
+    constexpr uint32_t PAGE_BATCH = 8;
+
+    // Single-page alloc/free through the per-HART hot lists against the locked buddy lists, 1 to 16 kthreads
+    void pages() {
+        printf("bench: pages, %d batches of %d pages per thread\n", PAGE_OPS, PAGE_BATCH);
+        for (uint32_t n = 1; n <= 16; n *= 2) {
+            uint64_t hot_ticks = run_parallel(n, [](uint32_t id) {
+                paddr_t batch[PAGE_BATCH];
+                for (uint32_t i = 0; i < PAGE_OPS; i++) {
+                    for (uint32_t j = 0; j < PAGE_BATCH; j++) {
+                        batch[j] = pallocator::alloc_page();
+                    }
+                    for (uint32_t j = 0; j < PAGE_BATCH; j++) {
+                        pallocator::dealloc_pages(batch[j]);
+                    }
+                }
+            });
+
+            uint64_t buddy_ticks = run_parallel(n, [](uint32_t id) {
+                paddr_t batch[PAGE_BATCH];
+                for (uint32_t i = 0; i < PAGE_OPS; i++) {
+                    for (uint32_t j = 0; j < PAGE_BATCH; j++) {
+                        batch[j] = pallocator::alloc_pages(0);
+                    }
+                    for (uint32_t j = 0; j < PAGE_BATCH; j++) {
+                        pallocator::free_pages(batch[j], 0);
+                    }
+                }
+            });
+
+            uint32_t ops = n * PAGE_OPS * PAGE_BATCH;
+            printf("bench: %d threads: hot lists %d ticks (%d ticks/1000 ops), buddy %d ticks (%d ticks/1000 ops)\n",
+                   n, (uint32_t)hot_ticks, (uint32_t)(hot_ticks * 1000 / ops),
+                   (uint32_t)buddy_ticks, (uint32_t)(buddy_ticks * 1000 / ops));
+        }
+        pallocator::dump_stats();
+    }
+
+    constexpr uint32_t MEM_BYTES = 256 * 1024; // Bytes moved per measurement, whatever the size
+    constexpr uint32_t MEM_SIZES[] = {8, 32, 128, 512, 4096};
+
+    // The byte loops memcpy and memset used to be, kept from turning into library calls
+    __attribute__((optimize("no-tree-loop-distribute-patterns")))
+    static void byte_copy(uint8_t* d, const uint8_t* s, size_t n) {
+        while (n--) {
+            *d++ = *s++;
+        }
+    }
+
+    __attribute__((optimize("no-tree-loop-distribute-patterns")))
+    static void byte_fill(uint8_t* d, uint8_t c, size_t n) {
+        while (n--) {
+            *d++ = c;
+        }
+    }
+
+    template <typename Op>
+    static uint32_t time_mem(uint32_t size, Op op) {
+        uint64_t start = pit::get_time();
+        for (uint32_t done = 0; done < MEM_BYTES; done += size) {
+            op();
+        }
+        return (uint32_t)(pit::get_time() - start);
+    }
+
+    // memcpy, memmove, memset and memcmp against byte loops, sweeping sizes and source misalignment
+    void memory() {
+        uint8_t* src = new uint8_t[4096 + 8];
+        uint8_t* dst = new uint8_t[4096 + 8];
+        for (uint32_t i = 0; i < 4096 + 8; i++) {
+            src[i] = (uint8_t)i;
+        }
+        printf("bench: memory, ticks per %d bytes\n", MEM_BYTES);
+        for (uint32_t size : MEM_SIZES) {
+            for (uint32_t misalign = 0; misalign < 4; misalign++) {
+                const uint8_t* s = src + misalign;
+                uint32_t bytes = time_mem(size, [&] { byte_copy(dst, s, size); });
+                uint32_t copy = time_mem(size, [&] { memcpy(dst, s, size); });
+                uint32_t move = time_mem(size, [&] { memmove(dst + 4, dst + misalign, size); });
+                uint32_t cmp = time_mem(size, [&] { (void)memcmp(dst, dst + 4 - misalign, size); });
+                printf("bench: %d bytes, src +%d: byte loop %d, memcpy %d, memmove %d, memcmp %d\n",
+                       size, misalign, bytes, copy, move, cmp);
+            }
+            uint32_t bytes = time_mem(size, [&] { byte_fill(dst, 0x5a, size); });
+            uint32_t fill = time_mem(size, [&] { memset(dst, 0x5a, size); });
+            printf("bench: %d bytes: byte fill %d, memset %d\n", size, bytes, fill);
+        }
+        delete[] src;
+        delete[] dst;
+    }
+
+    constexpr uint32_t DATAPATH_SIZES[] = {512, 4096};
+
+    // Each data-path kernel, scalar against vector, ticks per MEM_BYTES
+    static void time_kernels(const datapath::Kernels& kernels, uint32_t size, uint8_t* a, uint8_t* b) {
+        uint32_t copy = time_mem(size, [&] { kernels.copy(b, a, size); });
+        uint32_t fill = time_mem(size, [&] { kernels.fill(b, 0x5a, size); });
+        kernels.copy(b, a, size);
+        uint32_t compare = time_mem(size, [&] { (void)kernels.compare(a, b, size); });
+        uint32_t crc = 0;
+        uint32_t crc_ticks = time_mem(size, [&] { crc = kernels.crc32c(crc, a, size); });
+        memset(b, 0, size);
+        uint32_t find = time_mem(size, [&] { (void)kernels.find_nonzero((const uint32_t*)b, size / sizeof(uint32_t)); });
+        printf("bench: %s, %d bytes: copy %d, fill %d, compare %d, crc32c %d, find_nonzero %d\n",
+               kernels.name, size, copy, fill, compare, crc_ticks, find);
+    }
+
+    // Scalar and RVV data-path kernels, after checking that both agree
+    void vector_kernels() {
+        uint8_t* a = new uint8_t[4096];
+        uint8_t* b = new uint8_t[4096];
+        for (uint32_t i = 0; i < 4096; i++) {
+            a[i] = (uint8_t)(i * 31 + 7);
+        }
+        ASSERT(datapath::scalar.crc32c(0, "123456789", 9) == 0xE3069283);
+        if (datapath::vector_enabled()) {
+            for (uint32_t size : DATAPATH_SIZES) {
+                ASSERT(datapath::vector.crc32c(0, a, size) == datapath::scalar.crc32c(0, a, size));
+                datapath::vector.copy(b, a, size);
+                ASSERT(datapath::scalar.compare(a, b, size) == 0);
+                b[size - 3] ^= 1;
+                ASSERT(datapath::vector.compare(a, b, size) == datapath::scalar.compare(a, b, size));
+                memset(b, 0, size);
+                b[size - 8] = 1;
+                ASSERT(datapath::vector.find_nonzero((const uint32_t*)b, size / sizeof(uint32_t)) == (int32_t)(size / sizeof(uint32_t) - 2));
+            }
+        } else {
+            printf("bench: no V extension, only the scalar kernels run\n");
+        }
+        printf("bench: data-path kernels, ticks per %d bytes\n", MEM_BYTES);
+        for (uint32_t size : DATAPATH_SIZES) {
+            time_kernels(datapath::scalar, size, a, b);
+            if (datapath::vector_enabled()) {
+                time_kernels(datapath::vector, size, a, b);
+            }
+        }
+        delete[] a;
+        delete[] b;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common/common.h"
+#include "threads/threads.h"
+#include "sync/barrier.h"
+#include "sync/latch.h"
+#include "sync/shared.h"
+
+// Microbenchmarks, call them from kernel_main
+namespace bench {
+    constexpr uint64_t TIMEBASE_HZ = 10000000; // QEMU virt timer frequency
+
+    // Runs work(i) for i in [0, n) on n kthreads, returns the timer ticks from release until all have finished
+    template <typename Work>
+    uint64_t run_parallel(uint32_t n, Work work) {
+        SharedPtr<Latch> start = make_shared<Latch>(n + 1);
+        SharedPtr<Latch> end = make_shared<Latch>(n);
+        for (uint32_t i = 0; i < n; i++) {
+            threads::kthread([start, end, work, i]() mutable {
+                start->arrive_and_wait();
+                work(i);
+                end->count_down();
+            });
+        }
+        start->arrive_and_wait();
+        uint64_t begin = pit::get_time();
+        end->wait();
+        return pit::get_time() - begin;
+    }
+
+    extern void mpmc_queue();
+    extern void atomics();
+    extern void barriers();
+    extern void disk_fanout();
+    extern void concurrent_map();
+    extern void pool();
+    extern void rcu_map();
+    extern void counters();
+    extern void pipeline();
+    extern void fork_join();
+    extern void slab();
+    extern void pages();
+    extern void memory();
+    extern void vector_kernels();
+};
\ No newline at end of file
@@ -3,17 +3,22 @@
 #include "../common/common.h"
 #include "smp.h"
 #include "../threads/threads.h"
+#include "../threads/scheduler.h"
+#include "../slab.h"
 #include "../kernel_main.h"
 #include "pit.h"
 #include "../drivers/virtio-blk/virtio-blk.h"
 #include "../drivers/virtio-blk/virtio.h"
 #include "plic.h"
+#include "../sync/rcu.h"
+#include "../common/datapath.h"
 
 typedef unsigned char uint8_t;
 typedef unsigned int uint32_t;
 typedef uint32_t size_t;
 
 extern char __bss[], __bss_end[], __stack_top[];
+extern Spinlock printLock; // Defined in common.cc
 extern char __free_ram[], __free_ram_end[];
 
 const uint32_t HEAP_SIZE = 2 * 1024 * 1024;
@@ -65,6 +70,7 @@ void kernel_init_2(void) {
     }
 
     printf("| HART %d successfully booted!\n", hartid);
+    rcu::online(); // Grace periods wait for this HART from now on
 
     /*
     for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
@@ -271,6 +277,10 @@ void kernel_init(void) {
 
     memset(__bss, 0, (size_t) __bss_end - (size_t) __bss); // Set globals (bss section) to 0
     printf("| It's alive!\n");
+    printLock.set_name("printf");
+
+    datapath::init();
+    printf("| Data-path kernels: %s\n", datapath::active.name);
 
     WRITE_CSR(stvec, (uint32_t) kernel_entry); // Register the trap handler
     printf("| Exceptions can now be handled!\n");
@@ -279,6 +289,8 @@ void kernel_init(void) {
     printf("| Initialized the heap\n");
     pallocator::init((paddr_t)(__free_ram + HEAP_SIZE), (size_t)(__free_ram_end - __free_ram - HEAP_SIZE)); // Initialize the physical memory allocator
     printf("| Initialized the physical memory allocator\n");
+    slab::init();
+    printf("| Initialized the slab allocator\n");
 
     /* Start secondary harts */
     printf("| Starting secondary harts...\n");
@@ -286,6 +298,7 @@ void kernel_init(void) {
 
     /* GLOBAL INIT */
     threads::init(); // Sets up idle threads, etc.
+    scheduler::init();
 
     virtio_blk_init();
 
@@ -1,4 +1,5 @@
 #include "smp.h"
+#include "pit.h"
 
 namespace smp {
     /**
@@ -9,4 +10,39 @@ namespace smp {
         __asm__ volatile("mv %0, tp" : "=r"(hartid));
         return hartid;
     }
+
+    /**
+     * Adds delta to this HART's slot, folding it into the global count once it reaches BATCH
+     * Only the owning HART writes a slot, so a plain load and store are enough
+     */
+    void PerCPUCounter::add(int32_t delta) {
+        bool was = pit::disable_interrupts();
+        Atomic<int32_t>& slot = local.mine();
+        int32_t count = slot.get(MemoryOrder::RELAXED) + delta;
+        if (count >= BATCH || count <= -BATCH) {
+            global.fetch_add(count, MemoryOrder::RELAXED);
+            count = 0;
+        }
+        slot.set(count, MemoryOrder::RELAXED);
+        pit::restore_interrupts(was);
+    }
+
+    /**
+     * Returns the folded count, without what the HARTs have not folded yet
+     */
+    int64_t PerCPUCounter::read() const {
+        return global.get(MemoryOrder::RELAXED);
+    }
+
+    /**
+     * Returns the folded count plus every HART's unfolded slot
+     * Still approximate while other HARTs are adding
+     */
+    int64_t PerCPUCounter::sum() {
+        int64_t total = global.get(MemoryOrder::RELAXED);
+        for (uint32_t id = 0; id < MAX_HARTS; id++) {
+            total += local.forCPU(id).get(MemoryOrder::RELAXED);
+        }
+        return total;
+    }
 }
\ No newline at end of file
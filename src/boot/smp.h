@@ -1,22 +1,43 @@
 #pragma once
 
 #include "../common/common.h"
+#include "../sync/atomic.h"
 
 namespace smp {
     const int MAX_HARTS = 16;
     extern uint32_t me();
 
+    // One T per HART, each in its own cache lines so HARTs never false-share their slots
     template <typename T>
     class PerCPU {
-        T data[MAX_HARTS];
+        struct alignas(CACHE_LINE_SIZE) Slot {
+            T value;
+        };
+        Slot data[MAX_HARTS];
     public:
         T& forCPU(uint32_t id) {
             ASSERT(id >= 0 && id < MAX_HARTS);
-            return data[id];
+            return data[id].value;
         }
         T& mine() {
             int me = smp::me();
             return this->forCPU(me);
         }
     };
+
+    // Sloppy statistics counter, after Linux's percpu_counter
+    // add() only touches this HART's slot, which is folded into the global count every BATCH units
+    // read() is cheap but may be off by up to MAX_HARTS * BATCH, sum() adds up every slot
+    // An all-zero PerCPUCounter is valid
+    class PerCPUCounter {
+        static constexpr int32_t BATCH = 64;
+
+        PerCPU<Atomic<int32_t>> local;
+        Atomic<int64_t> global;
+
+    public:
+        void add(int32_t delta = 1);
+        int64_t read() const;
+        int64_t sum();
+    };
 };
\ No newline at end of file
@@ -0,0 +1 @@
+#include "bits.h"
\ No newline at end of file
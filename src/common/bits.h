@@ -0,0 +1,17 @@
+#pragma once
+
+#include "common.h"
+
+namespace bits {
+
+    // Count trailing zeros with a de Bruijn multiply
+    // rv32imac has no ctz instruction and __builtin_ctz would call into libgcc, which we don't link
+    inline uint32_t ctz32(uint32_t x) {
+        static constexpr uint8_t POSITIONS[32] = {
+            0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+            31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+        };
+        ASSERT(x != 0);
+        return POSITIONS[((x & -x) * 0x077CB531u) >> 27];
+    }
+};
\ No newline at end of file
@@ -5,22 +5,151 @@ void putchar(char ch);
 
 Spinlock printLock{};
 
-extern "C" void *memset(void *buf, int c, size_t n) {
+// Memory routines work a word at a time once the destination is word aligned, misaligned word accesses
+// trap to OpenSBI on RISC-V and are far slower than bytes
+// may_alias lets word accesses touch memory of any type, and gcc must not turn the loops back into
+// calls to the very functions they implement
+typedef uint32_t __attribute__((may_alias)) word_t;
+static const size_t WORD = sizeof(word_t);
+static const size_t SMALL = 16; // Below this the setup costs more than byte loops
+#define MEMFN extern "C" __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+MEMFN void *memset(void *buf, int c, size_t n) {
     uint8_t *p = (uint8_t *) buf;
+    if (n >= SMALL) {
+        while ((uintptr_t)p & (WORD - 1)) {
+            *p++ = (uint8_t)c;
+            n--;
+        }
+        word_t fill = (uint8_t)c * 0x01010101u;
+        word_t *w = (word_t *) p;
+        for (; n >= 4 * WORD; n -= 4 * WORD, w += 4) {
+            w[0] = fill;
+            w[1] = fill;
+            w[2] = fill;
+            w[3] = fill;
+        }
+        for (; n >= WORD; n -= WORD)
+            *w++ = fill;
+        p = (uint8_t *) w;
+    }
     while (n--)
         *p++ = (uint8_t)c;
     return buf;
 }
 
-void *memcpy(void *dst, const void *src, size_t n) {
+// Copies forwards, so it is also safe for overlapping buffers with dst below src
+MEMFN void *memcpy(void *dst, const void *src, size_t n) {
     uint8_t *d = (uint8_t *) dst;
     const uint8_t *s = (const uint8_t *) src;
-    while (n--) {
+    if (n >= SMALL) {
+        while ((uintptr_t)d & (WORD - 1)) {
+            *d++ = *s++;
+            n--;
+        }
+        word_t *wd = (word_t *) d;
+        uint32_t off = (uintptr_t)s & (WORD - 1);
+        if (off == 0) {
+            const word_t *ws = (const word_t *) s;
+            for (; n >= 4 * WORD; n -= 4 * WORD, wd += 4, ws += 4) {
+                word_t a = ws[0], b = ws[1], c = ws[2], e = ws[3]; // All loads before any store
+                wd[0] = a;
+                wd[1] = b;
+                wd[2] = c;
+                wd[3] = e;
+            }
+            for (; n >= WORD; n -= WORD)
+                *wd++ = *ws++;
+            s = (const uint8_t *) ws;
+        } else {
+            // Aligned loads shifted together, little endian. The last load may read up to 3 bytes
+            // past the source, but never past the aligned word holding its last byte
+            const word_t *ws = (const word_t *)(s - off);
+            uint32_t right = off * 8;
+            uint32_t left = 32 - right;
+            word_t lo = *ws++;
+            for (; n >= WORD; n -= WORD) {
+                word_t hi = *ws++;
+                *wd++ = (lo >> right) | (hi << left);
+                lo = hi;
+                s += WORD;
+            }
+        }
+        d = (uint8_t *) wd;
+    }
+    while (n--)
         *d++ = *s++;
+    return dst;
+}
+
+MEMFN void *memmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *) dst;
+    const uint8_t *s = (const uint8_t *) src;
+    if (d <= s || d >= s + n)
+        return memcpy(dst, src, n);
+
+    // dst overlaps the end of src, copy backwards
+    d += n;
+    s += n;
+    if (n >= SMALL && (((uintptr_t)d ^ (uintptr_t)s) & (WORD - 1)) == 0) {
+        while ((uintptr_t)d & (WORD - 1)) {
+            *--d = *--s;
+            n--;
+        }
+        word_t *wd = (word_t *) d;
+        const word_t *ws = (const word_t *) s;
+        for (; n >= WORD; n -= WORD)
+            *--wd = *--ws;
+        d = (uint8_t *) wd;
+        s = (const uint8_t *) ws;
     }
+    while (n--)
+        *--d = *--s;
     return dst;
 }
 
+MEMFN int memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *p = (const uint8_t *) a;
+    const uint8_t *q = (const uint8_t *) b;
+    if (n >= SMALL && (((uintptr_t)p ^ (uintptr_t)q) & (WORD - 1)) == 0) {
+        while ((uintptr_t)p & (WORD - 1)) {
+            if (*p != *q)
+                return *p - *q;
+            p++;
+            q++;
+            n--;
+        }
+        // Skip equal words, the bytes below find the order of the first difference
+        while (n >= WORD && *(const word_t *) p == *(const word_t *) q) {
+            p += WORD;
+            q += WORD;
+            n -= WORD;
+        }
+    }
+    for (; n; n--, p++, q++) {
+        if (*p != *q)
+            return *p - *q;
+    }
+    return 0;
+}
+
+MEMFN size_t strlen(const char *str) {
+    const char *s = str;
+    while ((uintptr_t)s & (WORD - 1)) {
+        if (!*s)
+            return s - str;
+        s++;
+    }
+    // A word has a zero byte iff (w - 0x01..) & ~w & 0x80.. is non-zero. Aligned reads never cross a page
+    const word_t *w = (const word_t *) s;
+    while (!((*w - 0x01010101u) & ~*w & 0x80808080u))
+        w++;
+    s = (const char *) w;
+    while (*s)
+        s++;
+    return s - str;
+}
+
 char *strcpy(char *dst, const char *src) {
     char *d = (char *) dst;
     const char *s = (const char *) src;
@@ -42,6 +171,36 @@ int strcmp(const char *s1, const char *s2) {
     return *(unsigned char *)s1 - *(unsigned char *)s2;
 }
 
+// rv32 has no 64-bit divide, gcc calls these libgcc helpers, which -nostdlib leaves out
+// Shift-and-subtract long division, only the benchmarks' rate calculations divide 64-bit values
+static uint64_t udivmod64(uint64_t n, uint64_t d, uint64_t *rem) {
+    if (d == 0) {
+        PANIC("64-bit division by zero");
+    }
+    uint64_t q = 0;
+    uint64_t r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if (r >= d) {
+            r -= d;
+            q |= (uint64_t)1 << i;
+        }
+    }
+    *rem = r;
+    return q;
+}
+
+extern "C" uint64_t __udivdi3(uint64_t n, uint64_t d) {
+    uint64_t rem;
+    return udivmod64(n, d, &rem);
+}
+
+extern "C" uint64_t __umoddi3(uint64_t n, uint64_t d) {
+    uint64_t rem;
+    udivmod64(n, d, &rem);
+    return rem;
+}
+
 // https://operating-system-in-1000-lines.vercel.app/en/05-hello-world
 void printf(const char *fmt, ...) {
     printLock.lock();
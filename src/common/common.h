@@ -4,12 +4,16 @@ typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
 typedef unsigned long long uint64_t;
+typedef int int32_t;
+typedef long long int64_t;
 typedef unsigned int size_t;
 typedef uint32_t paddr_t;
 typedef uint32_t vaddr_t;
 typedef uint32_t uintptr_t;
 
 #define NULL ((void *)0)
+
+constexpr size_t CACHE_LINE_SIZE = 64;
 #define align_up(value, align)   __builtin_align_up(value, align)
 #define is_aligned(value, align) __builtin_is_aligned(value, align)
 #define offsetof(type, member)   __builtin_offsetof(type, member)
@@ -35,6 +39,9 @@ typedef uint32_t uintptr_t;
 
 extern "C" void *memset(void *buf, int c, size_t n);
 extern "C" void *memcpy(void *dst, const void *src, size_t n);
+extern "C" void *memmove(void *dst, const void *src, size_t n);
+extern "C" int memcmp(const void *a, const void *b, size_t n);
+extern "C" size_t strlen(const char *str);
 char *strcpy(char *dst, const char *src);
 int strcmp(const char *s1, const char *s2);
 void printf(const char *fmt, ...);
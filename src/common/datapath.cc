@@ -0,0 +1,349 @@
+#include "datapath.h"
+#include "../boot/kernel.h"
+#include "../boot/pit.h"
+
+namespace datapath {
+
+    constexpr uint32_t SSTATUS_VS_MASK = 3 << 9;
+    constexpr uint32_t SSTATUS_VS_INITIAL = 1 << 9;
+    constexpr size_t VECTOR_MIN = 64; // Below this the scalar kernels win, vsetvli and the CSR writes cost too much
+    constexpr size_t VECTOR_CHUNK = 4096; // Most bytes handled per interrupts-off window
+
+    constexpr uint32_t CRC32C_POLY = 0x82F63B78; // Castagnoli polynomial, bit-reflected
+    constexpr uint32_t CRC_STRIDE = 64; // Bytes each vector lane consumes per block
+    constexpr uint32_t CRC_MAX_LANES = 16;
+
+    struct CRCTable {
+        uint32_t entries[256];
+    };
+
+    constexpr CRCTable make_crc_table() {
+        CRCTable table = {};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (uint32_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            }
+            table.entries[i] = crc;
+        }
+        return table;
+    }
+
+    // x^bits mod P, in the reflected representation where 0x80000000 is 1
+    constexpr uint32_t crc_x_pow(uint32_t bits) {
+        uint32_t p = 0x80000000;
+        while (bits-- > 0) {
+            p = (p & 1) ? (p >> 1) ^ CRC32C_POLY : p >> 1;
+        }
+        return p;
+    }
+
+    static constexpr CRCTable CRC_TABLE = make_crc_table();
+    // Shifts a lane's CRC state past the CRC_STRIDE bytes of the next lane
+    static constexpr uint32_t CRC_STRIDE_SHIFT = crc_x_pow(8 * CRC_STRIDE);
+
+    // a * b mod P for reflected polynomials, as in zlib's multmodp
+    static uint32_t crc_multiply(uint32_t a, uint32_t b) {
+        uint32_t m = 1u << 31;
+        uint32_t p = 0;
+        while (true) {
+            if (a & m) {
+                p ^= b;
+                if ((a & (m - 1)) == 0) {
+                    break;
+                }
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+        }
+        return p;
+    }
+
+    // Advances a raw (not inverted) CRC state over n bytes
+    static uint32_t crc_update(uint32_t state, const uint8_t* p, size_t n) {
+        while (n-- > 0) {
+            state = CRC_TABLE.entries[(state ^ *p++) & 0xff] ^ (state >> 8);
+        }
+        return state;
+    }
+
+    /* Scalar kernels */
+
+    static void scalar_copy(void* dst, const void* src, size_t n) {
+        memcpy(dst, src, n);
+    }
+
+    static void scalar_fill(void* dst, uint8_t c, size_t n) {
+        memset(dst, c, n);
+    }
+
+    static int scalar_compare(const void* a, const void* b, size_t n) {
+        return memcmp(a, b, n);
+    }
+
+    static uint32_t scalar_crc32c(uint32_t crc, const void* data, size_t n) {
+        return ~crc_update(~crc, (const uint8_t*)data, n);
+    }
+
+    static int32_t scalar_find_nonzero(const uint32_t* words, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (words[i] != 0) {
+                return (int32_t)i;
+            }
+        }
+        return -1;
+    }
+
+    /* Vector kernels */
+
+    // Interrupts off and sstatus.VS on, vector state must not outlive the matching vector_end
+    static bool vector_begin() {
+        bool was = pit::disable_interrupts();
+        __asm__ __volatile__("csrs sstatus, %0" :: "r"(SSTATUS_VS_INITIAL));
+        return was;
+    }
+
+    static void vector_end(bool was) {
+        __asm__ __volatile__("csrc sstatus, %0" :: "r"(SSTATUS_VS_MASK));
+        pit::restore_interrupts(was);
+    }
+
+    // Each asm block below sets its own vtype and leaves nothing in vector registers for the next
+    static void vector_copy(void* dst, const void* src, size_t n) {
+        if (n < VECTOR_MIN) {
+            memcpy(dst, src, n);
+            return;
+        }
+        uint8_t* d = (uint8_t*)dst;
+        const uint8_t* s = (const uint8_t*)src;
+        while (n > 0) {
+            size_t chunk = n < VECTOR_CHUNK ? n : VECTOR_CHUNK;
+            n -= chunk;
+            bool was = vector_begin();
+            __asm__ __volatile__(
+                ".option push\n"
+                ".option arch, +v\n"
+                "1:\n"
+                "vsetvli t0, %[n], e8, m8, ta, ma\n"
+                "vle8.v v0, (%[s])\n"
+                "vse8.v v0, (%[d])\n"
+                "add %[s], %[s], t0\n"
+                "add %[d], %[d], t0\n"
+                "sub %[n], %[n], t0\n"
+                "bnez %[n], 1b\n"
+                ".option pop\n"
+                : [d] "+r"(d), [s] "+r"(s), [n] "+r"(chunk)
+                :
+                : "t0", "memory");
+            vector_end(was);
+        }
+    }
+
+    static void vector_fill(void* dst, uint8_t c, size_t n) {
+        if (n < VECTOR_MIN) {
+            memset(dst, c, n);
+            return;
+        }
+        uint8_t* d = (uint8_t*)dst;
+        uint32_t value = c;
+        while (n > 0) {
+            size_t chunk = n < VECTOR_CHUNK ? n : VECTOR_CHUNK;
+            n -= chunk;
+            bool was = vector_begin();
+            __asm__ __volatile__(
+                ".option push\n"
+                ".option arch, +v\n"
+                "vsetvli t0, %[n], e8, m8, ta, ma\n"
+                "vmv.v.x v0, %[c]\n" // Later vl are never larger than this first one
+                "1:\n"
+                "vsetvli t0, %[n], e8, m8, ta, ma\n"
+                "vse8.v v0, (%[d])\n"
+                "add %[d], %[d], t0\n"
+                "sub %[n], %[n], t0\n"
+                "bnez %[n], 1b\n"
+                ".option pop\n"
+                : [d] "+r"(d), [n] "+r"(chunk)
+                : [c] "r"(value)
+                : "t0", "memory");
+            vector_end(was);
+        }
+    }
+
+    static int vector_compare(const void* a, const void* b, size_t n) {
+        if (n < VECTOR_MIN) {
+            return memcmp(a, b, n);
+        }
+        const uint8_t* pa = (const uint8_t*)a;
+        const uint8_t* pb = (const uint8_t*)b;
+        size_t done = 0;
+        while (done < n) {
+            size_t chunk = n - done < VECTOR_CHUNK ? n - done : VECTOR_CHUNK;
+            const uint8_t* ca = pa + done;
+            const uint8_t* cb = pb + done;
+            size_t offset = 0;
+            int32_t first = -1; // Offset in this chunk of the first differing byte
+            bool was = vector_begin();
+            __asm__ __volatile__(
+                ".option push\n"
+                ".option arch, +v\n"
+                "1:\n"
+                "beqz %[n], 3f\n"
+                "vsetvli t0, %[n], e8, m8, ta, ma\n"
+                "vle8.v v0, (%[a])\n"
+                "vle8.v v8, (%[b])\n"
+                "vmsne.vv v16, v0, v8\n"
+                "vfirst.m t1, v16\n"
+                "bgez t1, 2f\n"
+                "add %[a], %[a], t0\n"
+                "add %[b], %[b], t0\n"
+                "add %[off], %[off], t0\n"
+                "sub %[n], %[n], t0\n"
+                "j 1b\n"
+                "2:\n"
+                "add %[first], %[off], t1\n"
+                "3:\n"
+                ".option pop\n"
+                : [a] "+r"(ca), [b] "+r"(cb), [n] "+r"(chunk), [off] "+r"(offset), [first] "+r"(first)
+                :
+                : "t0", "t1", "memory");
+            vector_end(was);
+            if (first >= 0) {
+                size_t i = done + (size_t)first;
+                return pa[i] < pb[i] ? -1 : 1;
+            }
+            done += offset;
+        }
+        return 0;
+    }
+
+    static int32_t vector_find_nonzero(const uint32_t* words, size_t n) {
+        if (n < VECTOR_MIN / sizeof(uint32_t)) {
+            return scalar_find_nonzero(words, n);
+        }
+        size_t done = 0;
+        while (done < n) {
+            size_t chunk = n - done < VECTOR_CHUNK / sizeof(uint32_t) ? n - done : VECTOR_CHUNK / sizeof(uint32_t);
+            const uint32_t* p = words + done;
+            size_t offset = 0;
+            int32_t first = -1;
+            bool was = vector_begin();
+            __asm__ __volatile__(
+                ".option push\n"
+                ".option arch, +v\n"
+                "1:\n"
+                "beqz %[n], 3f\n"
+                "vsetvli t0, %[n], e32, m8, ta, ma\n"
+                "vle32.v v0, (%[p])\n"
+                "vmsne.vi v16, v0, 0\n"
+                "vfirst.m t1, v16\n"
+                "bgez t1, 2f\n"
+                "slli t1, t0, 2\n"
+                "add %[p], %[p], t1\n"
+                "add %[off], %[off], t0\n"
+                "sub %[n], %[n], t0\n"
+                "j 1b\n"
+                "2:\n"
+                "add %[first], %[off], t1\n"
+                "3:\n"
+                ".option pop\n"
+                : [p] "+r"(p), [n] "+r"(chunk), [off] "+r"(offset), [first] "+r"(first)
+                :
+                : "t0", "t1", "memory");
+            vector_end(was);
+            if (first >= 0) {
+                return (int32_t)(done + (size_t)first);
+            }
+            done += offset;
+        }
+        return -1;
+    }
+
+    // There is no carry-less multiply without Zvbc, so the table lookup itself is vectorized instead:
+    // a block of lanes * CRC_STRIDE bytes is split into one contiguous stride per lane, each lane runs
+    // the byte-at-a-time table CRC over its stride with a strided load and an indexed table gather, and
+    // the lane states are then folded in order with state = state * x^(8 * CRC_STRIDE) ^ lane
+    static uint32_t vector_crc32c(uint32_t crc, const void* data, size_t n) {
+        const uint8_t* p = (const uint8_t*)data;
+        uint32_t state = ~crc;
+        uint32_t lanes;
+        bool was = vector_begin();
+        __asm__ __volatile__(
+            ".option push\n"
+            ".option arch, +v\n"
+            "vsetivli %0, 16, e32, m4, ta, ma\n"
+            ".option pop\n"
+            : "=r"(lanes));
+        vector_end(was);
+        ASSERT(lanes > 0 && lanes <= CRC_MAX_LANES);
+        size_t block = lanes * CRC_STRIDE;
+        while (n >= block) {
+            uint32_t lane_states[CRC_MAX_LANES] = {};
+            lane_states[0] = state;
+            const uint8_t* column = p;
+            uint32_t steps = CRC_STRIDE;
+            was = vector_begin();
+            __asm__ __volatile__(
+                ".option push\n"
+                ".option arch, +v\n"
+                "vsetvli zero, %[lanes], e32, m4, ta, ma\n"
+                "vle32.v v0, (%[states])\n"
+                "li t0, 0xff\n"
+                "1:\n"
+                "vlse8.v v8, (%[col]), %[stride]\n" // Byte j of every lane
+                "vzext.vf4 v12, v8\n"
+                "vxor.vv v4, v0, v12\n"
+                "vand.vx v4, v4, t0\n"
+                "vsll.vi v4, v4, 2\n"
+                "vluxei32.v v16, (%[table]), v4\n"
+                "vsrl.vi v0, v0, 8\n"
+                "vxor.vv v0, v0, v16\n"
+                "addi %[col], %[col], 1\n"
+                "addi %[steps], %[steps], -1\n"
+                "bnez %[steps], 1b\n"
+                "vse32.v v0, (%[states])\n"
+                ".option pop\n"
+                : [col] "+r"(column), [steps] "+r"(steps)
+                : [lanes] "r"(lanes), [states] "r"(lane_states), [stride] "r"(CRC_STRIDE),
+                  [table] "r"(CRC_TABLE.entries)
+                : "t0", "memory");
+            vector_end(was);
+            state = lane_states[0];
+            for (uint32_t i = 1; i < lanes; i++) {
+                state = crc_multiply(CRC_STRIDE_SHIFT, state) ^ lane_states[i];
+            }
+            p += block;
+            n -= block;
+        }
+        return ~crc_update(state, p, n);
+    }
+
+    constexpr Kernels scalar = {
+        scalar_copy, scalar_fill, scalar_compare, scalar_crc32c, scalar_find_nonzero, "scalar"
+    };
+
+    constexpr Kernels vector = {
+        vector_copy, vector_fill, vector_compare, vector_crc32c, vector_find_nonzero, "rvv"
+    };
+
+    constinit Kernels active = scalar; // Constant initialized, valid before init() and the BSS clear
+
+    static bool has_vector = false;
+
+    /**
+     * Probes for the V extension and switches active to the vector kernels if it is present
+     * sstatus.VS is WARL and reads back as Off on HARTs without V
+     * Must run on HART 0 after the BSS is cleared and before any other HART starts
+     */
+    void init() {
+        bool was = pit::disable_interrupts();
+        __asm__ __volatile__("csrs sstatus, %0" :: "r"(SSTATUS_VS_INITIAL));
+        has_vector = (READ_CSR(sstatus) & SSTATUS_VS_MASK) != 0;
+        __asm__ __volatile__("csrc sstatus, %0" :: "r"(SSTATUS_VS_MASK));
+        pit::restore_interrupts(was);
+        active = has_vector ? vector : scalar;
+    }
+
+    bool vector_enabled() {
+        return has_vector;
+    }
+};
\ No newline at end of file
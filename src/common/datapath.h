@@ -0,0 +1,50 @@
+#pragma once
+
+#include "common.h"
+
+// Bulk data-path kernels with a RISC-V Vector (RVV 1.0) implementation and a scalar fallback
+// init() probes for V at boot and points active at the vector kernels if it is there. Until then,
+// and on HARTs without V, every call goes to the scalar kernels
+// Vector kernels only run with interrupts off and sstatus.VS turned back off before they return,
+// so vector registers are never live across a trap or context switch and TCBs need not save them
+namespace datapath {
+
+    struct Kernels {
+        void (*copy)(void* dst, const void* src, size_t n);
+        void (*fill)(void* dst, uint8_t c, size_t n);
+        int (*compare)(const void* a, const void* b, size_t n); // memcmp sign
+        uint32_t (*crc32c)(uint32_t crc, const void* data, size_t n);
+        int32_t (*find_nonzero)(const uint32_t* words, size_t n); // Index of the first nonzero word, or -1
+        const char* name;
+    };
+
+    extern const Kernels scalar;
+    extern const Kernels vector;
+    extern Kernels active;
+
+    extern void init();
+    extern bool vector_enabled();
+
+    inline void copy(void* dst, const void* src, size_t n) {
+        active.copy(dst, src, n);
+    }
+
+    inline void fill(void* dst, uint8_t c, size_t n) {
+        active.fill(dst, c, n);
+    }
+
+    inline int compare(const void* a, const void* b, size_t n) {
+        return active.compare(a, b, n);
+    }
+
+    /**
+     * CRC32C (Castagnoli) of n bytes, continuing from crc, which is 0 for a new checksum
+     */
+    inline uint32_t crc32c(uint32_t crc, const void* data, size_t n) {
+        return active.crc32c(crc, data, n);
+    }
+
+    inline int32_t find_nonzero(const uint32_t* words, size_t n) {
+        return active.find_nonzero(words, n);
+    }
+};
\ No newline at end of file
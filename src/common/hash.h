@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+
+namespace hashing {
+
+    // Final mixer from MurmurHash3, every input bit affects every output bit
+    // so hashes can be masked down to a power-of-two table size
+    inline uint32_t mix32(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // Hashes the bytes of key, word-sized keys skip straight to the mixer
+    template <typename K>
+    uint32_t hash_of(const K& key) {
+        if constexpr (sizeof(K) == sizeof(uint32_t)) {
+            uint32_t word;
+            __builtin_memcpy(&word, &key, sizeof(word));
+            return mix32(word);
+        } else {
+            // FNV-1a
+            const uint8_t* bytes = (const uint8_t*)&key;
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < sizeof(K); i++) {
+                h ^= bytes[i];
+                h *= 16777619u;
+            }
+            return mix32(h);
+        }
+    }
+};
\ No newline at end of file
@@ -1,74 +1,189 @@
 #pragma once
 
 #include "common.h"
-#include "../sync/shared.h"
+#include "hash.h"
+#include "utility.h"
 
+// Open-addressing hash map with Robin Hood linear probing
+// Entries live in one flat array, with a parallel byte array holding each slot's probe distance + 1
+// (0 = empty), so probes scan a few bytes instead of chasing pointers
+// Inserts displace entries that are closer to their home slot, which keeps probe sequences short and
+// lets lookups stop as soon as they pass where the key would have been placed
+// Removal shifts the following entries back instead of leaving tombstones
+// K and V must be default constructible
 template <typename K, typename V>
-class HashNode {
-public:
-    K key;
-    V value;
-    SharedPtr<HashNode<K, V>> next;
-
-    HashNode(K key, V value) {
-        this->key = key;
-        this->value = value;
-        this->next = nullptr;
+class HashMap {
+    static constexpr uint32_t MIN_CAPACITY = 8;
+    static constexpr uint32_t MAX_DISTANCE = 255;
+
+    struct Entry {
+        K key;
+        V value;
+    };
+
+    Entry* entries;
+    uint8_t* distances; // Probe distance + 1 of each slot, 0 if the slot is empty
+    uint32_t capacity; // Power of two
+    uint32_t count;
+
+    uint32_t mask() const {
+        return capacity - 1;
     }
-};
 
-template <typename K, typename V>
-class HashMap {
-    uint32_t num_buckets;
-    SharedPtr<HashNode<K, V>>* buckets;
-    uint32_t hash(K key) {
-        uint32_t rolling_hash = 0;
-        for(size_t i = 0; i < sizeof(K); i++) {
-            rolling_hash += ((uint8_t*)(&key))[i] * 33 + 1899879;
+    // Grow once the table would be more than 7/8 full
+    bool needs_grow(uint32_t new_count) const {
+        return new_count * 8 > capacity * 7;
+    }
+
+    // Returns the slot holding key, or capacity if it is not present
+    uint32_t slot_of(const K& key) const {
+        uint32_t index = hashing::hash_of(key) & mask();
+        for (uint32_t distance = 1; distances[index] >= distance; distance++) {
+            if (distances[index] == distance && entries[index].key == key) {
+                return index;
+            }
+            index = (index + 1) & mask();
+        }
+        return capacity;
+    }
+
+    // Places a key that is known not to be present, returns false if a probe got too long
+    bool insert_new(Entry&& entry) {
+        uint32_t index = hashing::hash_of(entry.key) & mask();
+        uint32_t distance = 1;
+        while (true) {
+            if (distances[index] == 0) {
+                distances[index] = distance;
+                entries[index] = util::move(entry);
+                count++;
+                return true;
+            }
+            if (distances[index] < distance) {
+                // Rob the richer entry, keep probing to place it
+                util::swap(entries[index], entry);
+                uint8_t displaced = distances[index];
+                distances[index] = distance;
+                distance = displaced;
+            }
+            index = (index + 1) & mask();
+            distance++;
+            if (distance > MAX_DISTANCE) {
+                return false;
+            }
+        }
+    }
+
+    void rehash(uint32_t new_capacity) {
+        Entry* old_entries = entries;
+        uint8_t* old_distances = distances;
+        uint32_t old_capacity = capacity;
+
+        capacity = new_capacity;
+        count = 0;
+        entries = new Entry[capacity];
+        distances = new uint8_t[capacity]();
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old_distances[i] != 0 && !insert_new(util::move(old_entries[i]))) {
+                PANIC("HashMap probe distance overflow while rehashing\n");
+            }
         }
-        return rolling_hash;
+        delete[] old_entries;
+        delete[] old_distances;
     }
+
 public:
-    HashMap(uint32_t buckets) : num_buckets(buckets) {
-        this->buckets = new SharedPtr<HashNode<K, V>>[buckets];
+    HashMap(uint32_t expected) : count(0) {
+        capacity = MIN_CAPACITY;
+        while (needs_grow(expected)) {
+            capacity *= 2;
+        }
+        entries = new Entry[capacity];
+        distances = new uint8_t[capacity]();
     }
 
+    ~HashMap() {
+        delete[] entries;
+        delete[] distances;
+    }
+
+    HashMap(const HashMap&) = delete;
+    HashMap& operator=(const HashMap&) = delete;
+
+    uint32_t size() const {
+        return count;
+    }
+
+    /**
+     * Inserts key, or replaces its value if it is already present
+     */
     void put(K key, V value) {
-        uint32_t index = hash(key) % num_buckets;\
-        SharedPtr<HashNode<K, V>> head = this->buckets[index];
-        this->buckets[index] = SharedPtr<HashNode<K, V>>(new HashNode<K, V>(key, value));
-        this->buckets[index]->next = head;
+        uint32_t index = slot_of(key);
+        if (index != capacity) {
+            entries[index].value = util::move(value);
+            return;
+        }
+        if (needs_grow(count + 1)) {
+            rehash(capacity * 2);
+        }
+        Entry entry = {util::move(key), util::move(value)};
+        while (!insert_new(util::move(entry))) {
+            // entry holds whichever element was left unplaced, everything else is in the table
+            rehash(capacity * 2);
+        }
     }
 
+    /**
+     * Returns a pointer to the value for key, or nullptr if it is not present
+     * The pointer is invalidated by the next put or remove
+     */
+    V* find(const K& key) {
+        uint32_t index = slot_of(key);
+        return index == capacity ? nullptr : &entries[index].value;
+    }
+
+    bool contains(const K& key) const {
+        return slot_of(key) != capacity;
+    }
+
+    /**
+     * Returns the value for key, panics if it is not present
+     */
     V get(K key) {
-        uint32_t index = hash(key) % num_buckets;
-        SharedPtr<HashNode<K, V>> curr = this->buckets[index];
-        while (curr != nullptr) {
-            if (curr->key == key) {
-                return curr->value;
-            }
-            curr = curr->next;
+        V* value = find(key);
+        if (value == nullptr) {
+            PANIC("No element found in hashmap that matches the provided key\n");
         }
-        PANIC("No element found in hashmap that matches the provided key\n");
-        return *(new V());
+        return *value;
     }
 
     bool remove(K key) {
-        uint32_t index = hash(key) % num_buckets;
-        SharedPtr<HashNode<K, V>> curr = this->buckets[index];
-        SharedPtr<HashNode<K, V>> prev(nullptr);
-        while (curr != nullptr) {
-            if (curr->key == key) {
-                if (prev == nullptr) {
-                    this->buckets[index] = curr->next;
-                } else {
-                    prev->next = curr->next;
-                }
-                return true;
+        uint32_t index = slot_of(key);
+        if (index == capacity) {
+            return false;
+        }
+        // Backward shift: pull each following displaced entry one slot closer to home
+        uint32_t next = (index + 1) & mask();
+        while (distances[next] > 1) {
+            entries[index] = util::move(entries[next]);
+            distances[index] = distances[next] - 1;
+            index = next;
+            next = (next + 1) & mask();
+        }
+        distances[index] = 0;
+        entries[index] = Entry(); // Release whatever the value held
+        count--;
+        return true;
+    }
+
+    /**
+     * Calls f(key, value) for every entry
+     */
+    template <typename F>
+    void for_each(F f) {
+        for (uint32_t i = 0; i < capacity; i++) {
+            if (distances[i] != 0) {
+                f((const K&)entries[i].key, entries[i].value);
             }
-            prev = curr;
-            curr = curr->next;
         }
-        return false;
     }
 };
\ No newline at end of file
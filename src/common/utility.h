@@ -0,0 +1,33 @@
+#pragma once
+
+// Minimal replacements for the <utility> and <type_traits> pieces we need, there is no standard library
+namespace util {
+
+    template <typename T> struct remove_reference { typedef T type; };
+    template <typename T> struct remove_reference<T&> { typedef T type; };
+    template <typename T> struct remove_reference<T&&> { typedef T type; };
+
+    // Casts to an rvalue so the value can be moved from
+    template <typename T>
+    constexpr typename remove_reference<T>::type&& move(T&& value) noexcept {
+        return static_cast<typename remove_reference<T>::type&&>(value);
+    }
+
+    // Passes an argument on with the value category it was given
+    template <typename T>
+    constexpr T&& forward(typename remove_reference<T>::type& value) noexcept {
+        return static_cast<T&&>(value);
+    }
+
+    template <typename T>
+    constexpr T&& forward(typename remove_reference<T>::type&& value) noexcept {
+        return static_cast<T&&>(value);
+    }
+
+    template <typename T>
+    void swap(T& a, T& b) {
+        T tmp = move(a);
+        a = move(b);
+        b = move(tmp);
+    }
+};
\ No newline at end of file
@@ -1,15 +1,33 @@
 #include "virtio-blk.h"
 #include "virtio.h"
 #include "../../heap.h"
-#include "../../sync/pool.h"
-#include "../../sync/syncmap.h"
+#include "../../sync/mpmc_queue.h"
+#include "../../sync/concurrent_map.h"
+#include "../../sync/seqlock.h"
 #include "../../pallocator.h"
+#include "../../arena.h"
+#include "../../common/datapath.h"
 
 // https://operating-system-in-1000-lines.vercel.app/en/15-virtio-blk
 
 struct virtio_virtq *blk_request_vq; // Only 1 virtq, so this is global
-uint64_t blk_capacity; // Only 1 virtq, so this is global
-Pool<int>* descriptor_pool; // Pool of descriptors per virtq
+SeqLock<uint64_t> blk_capacity; // Only 1 virtq, so this is global. Read on every request, written once at init
+// Pool of free descriptor ids per virtq
+// Twice as many slots as ids, so a push can only find its slot taken by a consumer that claimed it a full
+// lap ago and has not republished it yet, never by one that is still mid-pop on the HART doing the push
+constexpr uint32_t DESCRIPTOR_POOL_SIZE = VIRTQ_ENTRY_NUM * 2;
+BlockingMPMCQueue<int, DESCRIPTOR_POOL_SIZE>* descriptor_pool;
+
+// Returns a descriptor id from the ISR, which must not yield
+// A full slot only means a consumer on another HART has not republished it yet, so spin until it has
+static void return_descriptor_from_isr(int id) {
+    while (!descriptor_pool->try_push(id)) {}
+}
+
+// Everything a request allocates lives in the arena of its head descriptor and is freed in one reset
+// The arena belongs to whoever claimed the descriptor, so it needs no lock
+constexpr size_t REQUEST_ARENA_SIZE = 1024;
+Arena* request_arenas[VIRTQ_ENTRY_NUM];
 
 struct BlockRequest {
     SharedPtr<Promise<bool>> blk_promise;
@@ -21,19 +39,20 @@ struct BlockRequest {
     int status_id;
     struct virtio_blk_req * blk_req;
 
-    BlockRequest(void* buf, uint32_t sector, int is_write, int desc_id, int data_id, int status_id, paddr_t blk_req) {
-        blk_promise = SharedPtr<Promise<bool>>(new Promise<bool>());
+    BlockRequest(void* buf, uint32_t sector, int is_write, int desc_id, int data_id, int status_id, struct virtio_blk_req* blk_req) {
+        blk_promise = make_shared<Promise<bool>>();
         this->buf = buf;
         this->sector = sector;
         this->is_write = is_write;
         this->desc_id = desc_id;
         this->data_id = data_id;
         this->status_id = status_id;
-        this->blk_req = (struct virtio_blk_req *)blk_req;
+        this->blk_req = blk_req;
     }
 };
 
-SyncMap<int,SharedPtr<BlockRequest>>* req_promises;
+ConcurrentMap<int,BlockRequest*>* req_promises; // Shared with the ISR, so it must not sleep
+SpinlockNoInterrupts kickLock; // Serializes writes to the avail ring
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Waddress-of-packed-member"
@@ -46,11 +65,14 @@ struct virtio_virtq *virtq_init(unsigned index) {
 
     ASSERT(vq->avail.flags == 0);
     // Ideally descriptor_pool is per-virtq instead of global
-    descriptor_pool = new Pool<int>();
+    descriptor_pool = new BlockingMPMCQueue<int, DESCRIPTOR_POOL_SIZE>();
+    for (int i = 0; i < VIRTQ_ENTRY_NUM; i++) {
+        descriptor_pool->push(i); // Mark this as an available descriptor
+    }
+    req_promises = new ConcurrentMap<int,BlockRequest*>(VIRTQ_ENTRY_NUM);
     for (int i = 0; i < VIRTQ_ENTRY_NUM; i++) {
-        descriptor_pool->free(new int(i)); // Mark this as an available descriptor
+        request_arenas[i] = new Arena(REQUEST_ARENA_SIZE);
     }
-    req_promises = new SyncMap<int,SharedPtr<BlockRequest>>(VIRTQ_ENTRY_NUM);
     // 1. Select the queue writing its index (first queue is 0) to QueueSel.
     virtio_reg_write32(VIRTIO_REG_QUEUE_SEL, index);
     // 5. Notify the device about the queue size by writing the size to QueueNum.
@@ -64,6 +86,7 @@ struct virtio_virtq *virtq_init(unsigned index) {
 #pragma GCC diagnostic pop
 
 void virtio_blk_init(void) {
+    kickLock.set_name("virtio kick");
     if (virtio_reg_read32(VIRTIO_REG_MAGIC) != 0x74726976)
         PANIC("| virtio: invalid magic value");
     if (virtio_reg_read32(VIRTIO_REG_VERSION) != 1)
@@ -85,13 +108,12 @@ void virtio_blk_init(void) {
     virtio_reg_write32(VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_DRIVER_OK);
 
     // Get the disk capacity.
-    blk_capacity = virtio_reg_read64(VIRTIO_REG_DEVICE_CONFIG + 0) * SECTOR_SIZE;
-    printf("| virtio-blk: capacity is %d bytes\n", (int)blk_capacity);
+    blk_capacity.write(virtio_reg_read64(VIRTIO_REG_DEVICE_CONFIG + 0) * SECTOR_SIZE);
+    printf("| virtio-blk: capacity is %d bytes\n", (int)blk_capacity.read());
 }
 
 // Notifies the device that there is a new request. `desc_index` is the index
 // of the head descriptor of the new request.
-SpinlockNoInterrupts kickLock;
 void virtq_kick(struct virtio_virtq *vq, int desc_index) {
     kickLock.lock();
     vq->avail.ring[vq->avail.index % VIRTQ_ENTRY_NUM] = desc_index;
@@ -108,43 +130,44 @@ bool virtq_is_busy(struct virtio_virtq *vq) {
 }
 
 // Reads/writes from/to virtio-blk device.
+// Synchronous: polls until the device finishes, the returned promise is already set
 SharedPtr<Promise<bool>> read_write_disk(void *buf, unsigned sector, int is_write) {
-    if (sector >= blk_capacity / SECTOR_SIZE) {
+    uint64_t capacity = blk_capacity.read();
+    if (sector >= capacity / SECTOR_SIZE) {
         printf("virtio: tried to read/write sector=%d, but capacity is %d\n",
-              sector, blk_capacity / SECTOR_SIZE);
-        SharedPtr<Promise<bool>> failure_promise = SharedPtr<Promise<bool>>(new Promise<bool>());
+              sector, (int)(capacity / SECTOR_SIZE));
+        SharedPtr<Promise<bool>> failure_promise = make_shared<Promise<bool>>();
         failure_promise->set(false);
         return failure_promise;
     }
 
-    // Collect 3 descriptors from the pool of descriptors
-    int* desc_id_ptr = descriptor_pool->allocate();
-    int* data_id_ptr = descriptor_pool->allocate();
-    int* status_id_ptr = descriptor_pool->allocate();
-    if (desc_id_ptr == nullptr || data_id_ptr == nullptr || status_id_ptr == nullptr) {
-        descriptor_pool->free(desc_id_ptr);
-        descriptor_pool->free(data_id_ptr);
-        descriptor_pool->free(status_id_ptr);
-        printf("virtio: warn: failed to allocate descriptors in virtq\n");
-        SharedPtr<Promise<bool>> failure_promise = SharedPtr<Promise<bool>>(new Promise<bool>());
-        failure_promise->set(false);
-        return failure_promise;
+    // Collect 3 descriptors from the pool of descriptors in one claim, so a thread never holds
+    // part of a chain while waiting for the rest
+    int ids[3];
+    uint32_t claimed;
+    while ((claimed = descriptor_pool->pop_n(ids, 3)) != 3) {
+        // push_n may take only a prefix, so return them one at a time, each waiting for its slot
+        for (uint32_t i = 0; i < claimed; i++) {
+            descriptor_pool->push(ids[i]);
+        }
+        threads::yield();
     }
-    int desc_id = *desc_id_ptr; // TODO: Delete the pointers here
-    int data_id = *data_id_ptr;
-    int status_id = *status_id_ptr;
+    int desc_id = ids[0];
+    int data_id = ids[1];
+    int status_id = ids[2];
 
-    // Dynamically allocate a block request
-    paddr_t blk_req_paddr = (paddr_t)(new virtio_blk_req()); //pallocator::alloc_page();
-    struct virtio_blk_req * blk_req = (struct virtio_blk_req *) blk_req_paddr;
+    // Allocate the block request in the head descriptor's arena
+    Arena* arena = request_arenas[desc_id];
+    struct virtio_blk_req * blk_req = arena->make<virtio_blk_req>();
+    paddr_t blk_req_paddr = (paddr_t) blk_req;
 
-    req_promises->put(desc_id, SharedPtr<BlockRequest>(new BlockRequest(buf, sector, is_write, desc_id, data_id, status_id, blk_req_paddr)));
+    req_promises->put(desc_id, arena->make<BlockRequest>(buf, sector, is_write, desc_id, data_id, status_id, blk_req));
 
     // Construct the request according to the virtio-blk specification.
     blk_req->sector = sector;
     blk_req->type = is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
     if (is_write)
-        memcpy(blk_req->data, buf, SECTOR_SIZE);
+        datapath::copy(blk_req->data, buf, SECTOR_SIZE);
 
     // Construct the virtqueue descriptors (using 3 descriptors).
     struct virtio_virtq *vq = blk_request_vq;
@@ -174,28 +197,30 @@ SharedPtr<Promise<bool>> read_write_disk(void *buf, unsigned sector, int is_writ
     if (blk_req->status != 0) {
         printf("virtio: warn: failed to read/write sector=%d status=%d\n",
                sector, blk_req->status);
-        delete blk_req;
 
-        SharedPtr<Promise<bool>> failure_promise = req_promises->get(desc_id)->blk_promise;
+        BlockRequest* request;
+        req_promises->take(desc_id, request);
+        SharedPtr<Promise<bool>> failure_promise = request->blk_promise;
+        arena->reset(); // Before the descriptors go back, the next owner of desc_id reuses the arena
         failure_promise->set(false);
-        req_promises->remove(desc_id);
-        descriptor_pool->free(desc_id_ptr);
-        descriptor_pool->free(data_id_ptr);
-        descriptor_pool->free(status_id_ptr);
+        descriptor_pool->push(desc_id);
+        descriptor_pool->push(data_id);
+        descriptor_pool->push(status_id);
         return failure_promise;
     }
 
     // For read operations, copy the data into the buffer.
     if (!is_write)
-        memcpy(buf, blk_req->data, SECTOR_SIZE);
+        datapath::copy(buf, blk_req->data, SECTOR_SIZE);
 
-    delete blk_req;
-    SharedPtr<Promise<bool>> success_promise = req_promises->get(desc_id)->blk_promise;
+    BlockRequest* request;
+    req_promises->take(desc_id, request);
+    SharedPtr<Promise<bool>> success_promise = request->blk_promise;
+    arena->reset();
     success_promise->set(true);
-    req_promises->remove(desc_id);
-    descriptor_pool->free(desc_id_ptr);
-    descriptor_pool->free(data_id_ptr);
-    descriptor_pool->free(status_id_ptr);
+    descriptor_pool->push(desc_id);
+    descriptor_pool->push(data_id);
+    descriptor_pool->push(status_id);
     return success_promise;
 }
 
@@ -207,28 +232,28 @@ void virtio_blk_isr() {
         // Process the used entry
         int desc_id = (int)vq->used.ring[vq->last_used_index % VIRTQ_ENTRY_NUM].id;
         //printf("ISR Processing used entry for desc_id = %d\n", desc_id);
-        SharedPtr<BlockRequest> request = req_promises->get(desc_id);
+        BlockRequest* request = req_promises->get(desc_id);
         SharedPtr<Promise<bool>> promise = request->blk_promise;
         ASSERT(promise != nullptr);
         if (request->blk_req->status != 0) {
             printf("virtio: warn: failed to read/write sector=%d status=%d\n",
                 request->sector, request->blk_req->status);
-            delete request->blk_req;
+            // read_write_disk frees the request with its arena
 
             // req_promises->remove(desc_id); // Why remove the request? Don't I still need it in the readwrite?
-            descriptor_pool->free(new int(request->desc_id));
-            descriptor_pool->free(new int(request->data_id));
-            descriptor_pool->free(new int(request->status_id));
+            return_descriptor_from_isr(request->desc_id);
+            return_descriptor_from_isr(request->data_id);
+            return_descriptor_from_isr(request->status_id);
             promise->set(false);
             vq->last_used_index++;
             return;
         }
         // req_promises->remove(desc_id); // // Why remove the request? Don't I still need it in the readwrite?
-        descriptor_pool->free(new int(request->desc_id));
-        descriptor_pool->free(new int(request->data_id));
-        descriptor_pool->free(new int(request->status_id));
+        return_descriptor_from_isr(request->desc_id);
+        return_descriptor_from_isr(request->data_id);
+        return_descriptor_from_isr(request->status_id);
         if (!request->is_write) {
-            memcpy(request->buf, request->blk_req->data, SECTOR_SIZE);
+            datapath::copy(request->buf, request->blk_req->data, SECTOR_SIZE);
         }
         //printf("Setting promise to true for desc_id = %d\n", desc_id);
         promise->set(true);
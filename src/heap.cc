@@ -1,4 +1,7 @@
 #include "heap.h"
+#include "slab.h"
+#include "pallocator.h"
+#include "heap_profile.h"
 #include "sync/spinlock.h"
 
 // ChatGPT wrote this
@@ -17,13 +20,77 @@ struct BlockHeader {
     BlockHeader* next;          // next block in list
 };
 
+// ===========================================================
+// Regions
+// ===========================================================
+
+// A contiguous run of first-fit blocks. The first region is the area handed to init, the rest are
+// REGION_SIZE buddy blocks pulled from pallocator when every region is full
+struct Region {
+    Region* next;
+    size_t size;          // bytes of blocks after the header
+};
+
+static const uint32_t REGION_ORDER = 8;
+static const size_t REGION_SIZE = pallocator::PAGE_SIZE << REGION_ORDER;   // 1 MiB
+static const uint32_t REGION_SHIFT = 20;
+static_assert(REGION_SIZE == 1u << REGION_SHIFT, "REGION_SHIFT must match REGION_SIZE");
+
+// Allocations this large get their own pages, with a LargeHeader at the start of the first one
+static const size_t LARGE_MIN = 4 * pallocator::PAGE_SIZE;
+static const uint32_t LARGE_MAGIC = 0x1A26E001;
+
+struct LargeHeader {
+    uint32_t magic;
+    uint32_t order;
+    uint32_t pad[2];      // keep large allocations 16-byte aligned
+};
+
 // ===========================================================
 // Global allocator state
 // ===========================================================
 
-static BlockHeader* heap_start = 0;
-static size_t heap_total_size = 0;
-static BlockHeader* free_list = 0;
+static Region* initial_region = 0;
+static size_t initial_size = 0;
+static Region* regions = 0;
+// one bit per REGION_SIZE window of the address space, set while that window is a grown region
+static uint32_t grown[(1u << (32 - REGION_SHIFT)) / 32];
+
+static inline BlockHeader* blocks_of(Region* region) {
+    return (BlockHeader*)(region + 1);
+}
+
+static inline bool is_grown(uintptr_t addr) {
+    uint32_t window = addr >> REGION_SHIFT;
+    return (grown[window / 32] >> (window % 32)) & 1;
+}
+
+static inline void set_grown(uintptr_t addr, bool value) {
+    uint32_t window = addr >> REGION_SHIFT;
+    if (value)
+        grown[window / 32] |= 1u << (window % 32);
+    else
+        grown[window / 32] &= ~(1u << (window % 32));
+}
+
+// The region holding ptr, or 0 if ptr came from the slabs or the large path
+static Region* region_of(void* ptr) {
+    uint8_t* p = (uint8_t*)ptr;
+    if (p >= (uint8_t*)initial_region && p < (uint8_t*)initial_region + initial_size)
+        return initial_region;
+    if (is_grown((uintptr_t)p))
+        return (Region*)((uintptr_t)p & ~(uintptr_t)(REGION_SIZE - 1));
+    return 0;
+}
+
+// Carves a single free block out of the memory after the region header
+static void init_region(Region* region, size_t size) {
+    region->size = size - sizeof(Region);
+    BlockHeader* block = blocks_of(region);
+    block->size = region->size - sizeof(BlockHeader);
+    block->free = 1;
+    block->next = 0;
+}
 
 // ===========================================================
 // Initialize the heap
@@ -31,53 +98,81 @@ static BlockHeader* free_list = 0;
 
 void init(paddr_t start, size_t size) {
     heapLock = {};
-    heap_start = (BlockHeader*) start;
-    heap_total_size = size;
+    heapLock.set_name("heap");
+    initial_region = (Region*) start;
+    initial_size = size;
 
     // create a single big free block
-    free_list = heap_start;
-    free_list->size = size - sizeof(BlockHeader);
-    free_list->free = 1;
-    free_list->next = 0;
+    init_region(initial_region, size);
+    initial_region->next = 0;
+    regions = initial_region;
 }
 
 void dump_free_list() {
-    ASSERT(free_list != nullptr);
+    ASSERT(regions != nullptr);
     heapLock.lock();
-    BlockHeader* current = free_list;
     printf("-----------------------------------------\n");
-    printf("DUMPING FREE LIST starting at %x:\n", free_list);
-    while (current) {
-        if (current->free) {
-            printf("FREE BLOCK: start = %x, size = %d\n", ((uint8_t*)current) + 8, current->size);
-        } else {
-            printf("USED BLOCK: start = %x, size = %d\n", ((uint8_t*)current) + 8, current->size);
-        }
-        current = current->next;
-        if (current == free_list) {
-            printf("Somehow the list looped back around\n");
-            break;
+    for (Region* region = regions; region; region = region->next) {
+        printf("DUMPING REGION at %x, size = %d:\n", region, region->size);
+        for (BlockHeader* current = blocks_of(region); current; current = current->next) {
+            if (current->free) {
+                printf("FREE BLOCK: start = %x, size = %d\n", current + 1, current->size);
+            } else {
+                printf("USED BLOCK: start = %x, size = %d\n", current + 1, current->size);
+            }
         }
     }
     printf("-----------------------------------------\n");
     heapLock.unlock();
 }
 
+void free_extents(size_t& free_bytes, size_t& largest) {
+    free_bytes = 0;
+    largest = 0;
+    heapLock.lock();
+    for (Region* region = regions; region; region = region->next) {
+        for (BlockHeader* current = blocks_of(region); current; current = current->next) {
+            if (current->free) {
+                free_bytes += current->size;
+                if (current->size > largest)
+                    largest = current->size;
+            }
+        }
+    }
+    heapLock.unlock();
+}
+
 // ===========================================================
-// Allocate memory
+// Large allocations
 // ===========================================================
 
-void* malloc(size_t size) {
-    if (size == 0)
+static void* large_malloc(size_t size) {
+    uint32_t order = 0;
+    while ((pallocator::PAGE_SIZE << order) < size + sizeof(LargeHeader)) {
+        order++;
+        if (order > pallocator::MAX_ORDER)
+            return 0;
+    }
+    LargeHeader* header = (LargeHeader*) pallocator::alloc_pages(order);
+    if (!header)
         return 0;
+    header->magic = LARGE_MAGIC;
+    header->order = order;
+    return header + 1;
+}
 
-    // align size to 4 bytes
-    if (size & 3)
-        size = (size + 3) & ~3;
+static void large_free(LargeHeader* header) {
+    header->magic = 0;
+    pallocator::free_pages((paddr_t) header, header->order);
+}
 
-    heapLock.lock();
-    //BlockHeader* prev = 0;
-    BlockHeader* current = free_list;
+// ===========================================================
+// Allocate memory
+// ===========================================================
+
+// Caller holds heapLock
+static void* region_malloc(Region* region, size_t size) {
+    BlockHeader* current = blocks_of(region);
 
     while (current) {
         if (current->free && current->size >= size) {
@@ -99,55 +194,143 @@ void* malloc(size_t size) {
             }
 
             current->free = 0;
-
-            heapLock.unlock();
             return (void*)(current + 1);
         }
 
-        //prev = current;
         current = current->next;
-        if (current == free_list) {
-            PANIC("out of kernel heap space!\n");
-        }
     }
 
     // no free block found
-    heapLock.unlock();
     return 0;
 }
 
+// Caller holds heapLock, adds a REGION_SIZE region from pallocator
+static Region* grow() {
+    Region* region = (Region*) pallocator::alloc_pages(REGION_ORDER);
+    if (!region)
+        return 0;
+    init_region(region, REGION_SIZE);
+    set_grown((uintptr_t) region, true);
+    region->next = regions;
+    regions = region;
+    return region;
+}
+
+// site is the caller's return address, for the profile
+void* allocate(size_t size, void* site) {
+    if (size == 0)
+        return 0;
+
+    // Small sizes come from the slabs, which fall back to here once pallocator runs out
+    if (size <= slab::MAX_SIZE && slab::ready()) {
+        void* p = slab::malloc(size);
+        if (p != 0) {
+            uint32_t c = slab::class_index(size);
+            heap_profile::record_alloc(p, c, slab::class_size(c), site);
+            return p;
+        }
+    }
+
+    if (size >= LARGE_MIN) {
+        LargeHeader* p = (LargeHeader*) large_malloc(size);
+        if (p != 0)
+            heap_profile::record_alloc(p, heap_profile::LARGE_BUCKET, pallocator::PAGE_SIZE << p[-1].order, site);
+        return p;
+    }
+
+    // align size to 4 bytes
+    if (size & 3)
+        size = (size + 3) & ~3;
+
+    heapLock.lock();
+    void* p = 0;
+    for (Region* region = regions; region && !p; region = region->next)
+        p = region_malloc(region, size);
+    if (!p) {
+        Region* region = grow();
+        if (region)
+            p = region_malloc(region, size);
+    }
+    heapLock.unlock();
+    if (p != 0)
+        heap_profile::record_alloc(p, heap_profile::FIRST_FIT_BUCKET, (((BlockHeader*)p) - 1)->size, site);
+    return p;
+}
+
+void* malloc(size_t size) {
+    return allocate(size, __builtin_return_address(0));
+}
+
 // ===========================================================
 // Free memory
 // ===========================================================
 
+static inline bool is_empty(Region* region) {
+    BlockHeader* first = blocks_of(region);
+    return first->free && !first->next;
+}
+
+// Caller holds heapLock, hands region back to pallocator if it is grown and wholly free
+// One empty grown region is kept, like the slabs keep one empty slab, so a malloc/free pair at the edge
+// of a full heap doesn't allocate and free a whole region every time
+static void shrink(Region* region) {
+    if (region == initial_region || !is_empty(region))
+        return;
+
+    bool other_empty = false;
+    for (Region* r = regions; r && !other_empty; r = r->next)
+        other_empty = r != region && r != initial_region && is_empty(r);
+    if (!other_empty)
+        return;
+
+    Region** link = &regions;
+    while (*link != region)
+        link = &(*link)->next;
+    *link = region->next;
+    set_grown((uintptr_t) region, false);
+    pallocator::free_pages((paddr_t) region, REGION_ORDER);
+}
+
 void free(void* ptr) {
     if (!ptr)
         return;
 
-    heapLock.lock();
+    Region* region = region_of(ptr);
+    if (!region) {
+        // Anything outside the regions starts with a page header
+        // The profile must forget ptr before another HART can be handed the same address
+        LargeHeader* header = (LargeHeader*)((uintptr_t)ptr & ~(uintptr_t)(pallocator::PAGE_SIZE - 1));
+        if (header->magic == LARGE_MAGIC) {
+            heap_profile::record_free(ptr, heap_profile::LARGE_BUCKET, pallocator::PAGE_SIZE << header->order);
+            large_free(header);
+        } else {
+            uint32_t c = slab::class_of(ptr);
+            heap_profile::record_free(ptr, c, slab::class_size(c));
+            slab::free(ptr);
+        }
+        return;
+    }
+
     BlockHeader* block = ((BlockHeader*)ptr) - 1;
+    heap_profile::record_free(ptr, heap_profile::FIRST_FIT_BUCKET, block->size);
+    heapLock.lock();
     block->free = 1;
 
-    // coalesce adjacent free blocks
-    BlockHeader* current = free_list;
-    int iterations = 0;
-    int max_iterations = 10000; // prevent infinite loops from circular references
-    while (current && iterations < max_iterations) {
-        iterations++;
+    // coalesce adjacent free blocks, blocks of a region are contiguous and in address order
+    BlockHeader* current = blocks_of(region);
+    while (current) {
         BlockHeader* next = current->next;
         if (next && current->free && next->free) {
-            char* curr_end = (char*)(current + 1) + current->size;
-            if (curr_end == (char*)next) {
-                // merge adjacent blocks
-                current->size += sizeof(BlockHeader) + next->size;
-                current->next = next->next;
-                // Don't advance current; check if the merged block can merge with the next one
-                continue;
-            }
+            // merge adjacent blocks
+            current->size += sizeof(BlockHeader) + next->size;
+            current->next = next->next;
+            // Don't advance current; check if the merged block can merge with the next one
+            continue;
         }
         // Only advance current if no merge happened
         current = current->next;
     }
+    shrink(region);
     heapLock.unlock();
 }
 
@@ -157,20 +340,30 @@ void free(void* ptr) {
 /* C++ operators */
 /*****************/
 
+// Over-aligned allocations stash the pointer returned by heap::malloc right before the aligned block
+// so the matching delete can hand the original pointer back to heap::free
+static void* aligned_malloc(size_t size, size_t alignment, void* site) {
+    void* p = heap::allocate(size + alignment + sizeof(void*), site);
+    if (p == 0) PANIC("out of memory");
+    uintptr_t addr = reinterpret_cast<uintptr_t>(p) + sizeof(void*);
+    uintptr_t aligned_addr = (addr + alignment - 1) & ~(alignment - 1);
+    reinterpret_cast<void**>(aligned_addr)[-1] = p;
+    return reinterpret_cast<void*>(aligned_addr);
+}
+
+static void aligned_free(void* p) {
+    if (p == nullptr) return;
+    heap::free(reinterpret_cast<void**>(p)[-1]);
+}
+
 void* operator new(size_t size) {
-    void* p = heap::malloc(size);
+    void* p = heap::allocate(size, __builtin_return_address(0));
     if (p == 0) PANIC("out of memory");
     return p;
 }
 
 void* operator new(size_t size, std::align_val_t align) {
-    // For simplicity, allocate extra space and align manually
-    size_t alignment = static_cast<size_t>(align);
-    void* p = heap::malloc(size + alignment);
-    if (p == 0) PANIC("out of memory");
-    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
-    uintptr_t aligned_addr = (addr + alignment - 1) & ~(alignment - 1);
-    return reinterpret_cast<void*>(aligned_addr);
+    return aligned_malloc(size, static_cast<size_t>(align), __builtin_return_address(0));
 }
 
 void operator delete(void* p) noexcept {
@@ -182,26 +375,21 @@ void operator delete(void* p, size_t sz) {
 }
 
 void operator delete(void* p, std::align_val_t align) noexcept {
-    return heap::free(p);
+    return aligned_free(p);
 }
 
 void operator delete(void* p, size_t sz, std::align_val_t align) {
-    return heap::free(p);
+    return aligned_free(p);
 }
 
 void* operator new[](size_t size) {
-    void* p = heap::malloc(size);
+    void* p = heap::allocate(size, __builtin_return_address(0));
     if (p == 0) PANIC("out of memory");
     return p;
 }
 
 void* operator new[](size_t size, std::align_val_t align) {
-    size_t alignment = static_cast<size_t>(align);
-    void* p = heap::malloc(size + alignment);
-    if (p == 0) PANIC("out of memory");
-    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
-    uintptr_t aligned_addr = (addr + alignment - 1) & ~(alignment - 1);
-    return reinterpret_cast<void*>(aligned_addr);
+    return aligned_malloc(size, static_cast<size_t>(align), __builtin_return_address(0));
 }
 
 void operator delete[](void* p) noexcept {
@@ -213,9 +401,9 @@ void operator delete[](void* p, size_t sz) {
 }
 
 void operator delete[](void* p, std::align_val_t align) noexcept {
-    return heap::free(p);
+    return aligned_free(p);
 }
 
 void operator delete[](void* p, size_t sz, std::align_val_t align) {
-    return heap::free(p);
+    return aligned_free(p);
 }
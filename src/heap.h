@@ -6,6 +6,19 @@
 namespace heap {
     extern void init(paddr_t start, size_t size);
     extern void dump_free_list();
+    // Free bytes in the first-fit regions and the largest single free block among them
+    extern void free_extents(size_t& free_bytes, size_t& largest);
     extern "C" void* malloc(size_t size);
+    // malloc that attributes the allocation to site in heap_profile, new passes its caller
+    extern void* allocate(size_t size, void* site);
     extern "C" void free(void* p);
-};
\ No newline at end of file
+};
+
+// Placement new, constructs an object in memory that is already allocated
+inline void* operator new(size_t, void* ptr) noexcept {
+    return ptr;
+}
+
+inline void* operator new[](size_t, void* ptr) noexcept {
+    return ptr;
+}
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "heap_profile.h"
+#include "heap.h"
+#include "pallocator.h"
+#include "common/hash.h"
+#include "boot/smp.h"
+#include "boot/pit.h"
+#include "sync/spinlock.h"
+
+namespace heap_profile {
+
+    constexpr uint32_t SAMPLE_SLOTS = 1024; // Power of two
+    constexpr uint32_t MAX_SAMPLES = SAMPLE_SLOTS * 3 / 4; // Past this load samples from older epochs are evicted
+    constexpr uint32_t SITE_SLOTS = 256; // Power of two, sites past the table land in slot 0
+    constexpr uint32_t FILTER_SIZE = 256;
+    constexpr uint32_t TOP_SITES = 10;
+
+    struct HartCounts {
+        uint32_t allocs[NUM_BUCKETS];
+        uint32_t frees[NUM_BUCKETS];
+        uint64_t alloc_bytes[NUM_BUCKETS];
+        uint64_t free_bytes[NUM_BUCKETS];
+        int32_t live_bytes; // Can go negative when other HARTs free what this one allocated, one word so others can read it
+        uint32_t until_sample;
+    };
+
+    // A sampled allocation that has not been freed, ptr == 0 marks an empty slot
+    struct Sample {
+        uintptr_t ptr;
+        uint32_t site; // Index into sites
+        uint32_t bytes;
+        uint32_t epoch;
+    };
+
+    struct Site {
+        void* address;
+        uint32_t samples; // Sampled allocations ever made here
+        uint64_t bytes;
+    };
+
+    smp::PerCPU<HartCounts> counts;
+    Spinlock profLock;
+    Sample samples[SAMPLE_SLOTS]; // Open addressing on the pointer, protected by profLock
+    uint32_t sample_count;
+    uint32_t epoch_samples; // Samples of the current epoch
+    uint32_t evicted_samples; // Older samples evicted to make room for the current epoch
+    uint32_t dropped_samples; // Samples lost because the current epoch alone filled the table
+    uint32_t evict_cursor;
+    uint32_t peak_live_bytes; // Highest sum of every HART's live_bytes, checked at each sample
+    Site sites[SITE_SLOTS]; // Open addressing on the address, protected by profLock
+    uint32_t epoch;
+    // Live samples per pointer hash, read without the lock so unsampled frees skip it
+    Atomic<uint32_t> filter[FILTER_SIZE];
+
+    static uint32_t home_of(uintptr_t ptr) {
+        return hashing::mix32(ptr) & (SAMPLE_SLOTS - 1);
+    }
+
+    static uint32_t filter_of(uintptr_t ptr) {
+        return (hashing::mix32(ptr) >> 16) % FILTER_SIZE;
+    }
+
+    // Caller holds profLock
+    static uint32_t site_index(void* address) {
+        uint32_t i = hashing::mix32((uintptr_t)address) & (SITE_SLOTS - 1);
+        for (uint32_t probes = 0; probes < SITE_SLOTS; probes++) {
+            if (sites[i].address == address || sites[i].address == nullptr) {
+                sites[i].address = address;
+                return i;
+            }
+            i = (i + 1) & (SITE_SLOTS - 1);
+        }
+        return 0;
+    }
+
+    // Caller holds profLock, empties slot i
+    static void remove_at(uint32_t i) {
+        uintptr_t ptr = samples[i].ptr;
+        sample_count--;
+        if (samples[i].epoch == epoch) {
+            epoch_samples--;
+        }
+        Atomic<uint32_t>& count = filter[filter_of(ptr)];
+        count.set(count.get(MemoryOrder::RELAXED) - 1, MemoryOrder::RELAXED);
+
+        // Backward-shift deletion keeps every probe sequence unbroken without tombstones
+        uint32_t j = i;
+        while (true) {
+            j = (j + 1) & (SAMPLE_SLOTS - 1);
+            if (samples[j].ptr == 0) {
+                break;
+            }
+            uint32_t k = home_of(samples[j].ptr);
+            bool movable = i <= j ? (k <= i || k > j) : (k <= i && k > j);
+            if (movable) {
+                samples[i] = samples[j];
+                i = j;
+            }
+        }
+        samples[i].ptr = 0;
+    }
+
+    // Caller holds profLock and the table holds a sample from an older epoch, removes one
+    // Long-lived allocations from past epochs would otherwise fill the table and starve every later epoch
+    static void evict_old() {
+        while (samples[evict_cursor].ptr == 0 || samples[evict_cursor].epoch == epoch) {
+            evict_cursor = (evict_cursor + 1) & (SAMPLE_SLOTS - 1);
+        }
+        remove_at(evict_cursor); // May shift a later sample into the cursor's slot, it is checked next
+        evicted_samples++;
+    }
+
+    // Caller holds profLock
+    static void sample(uintptr_t ptr, size_t bytes, void* site) {
+        if (sample_count >= MAX_SAMPLES) {
+            if (epoch_samples == sample_count) {
+                dropped_samples++;
+                return;
+            }
+            evict_old();
+        }
+        uint32_t s = site_index(site);
+        sites[s].samples++;
+        sites[s].bytes += bytes;
+
+        uint32_t i = home_of(ptr);
+        while (samples[i].ptr != 0) {
+            i = (i + 1) & (SAMPLE_SLOTS - 1);
+        }
+        samples[i] = Sample{ptr, s, (uint32_t)bytes, epoch};
+        sample_count++;
+        epoch_samples++;
+        Atomic<uint32_t>& count = filter[filter_of(ptr)];
+        count.set(count.get(MemoryOrder::RELAXED) + 1, MemoryOrder::RELAXED);
+    }
+
+    // Caller holds profLock, removes ptr's sample if it has one
+    static void unsample(uintptr_t ptr) {
+        uint32_t i = home_of(ptr);
+        while (samples[i].ptr != ptr) {
+            if (samples[i].ptr == 0) {
+                return;
+            }
+            i = (i + 1) & (SAMPLE_SLOTS - 1);
+        }
+        remove_at(i);
+    }
+
+    // Sum of every HART's live_bytes, other HARTs' words may be slightly stale
+    static uint32_t live_bytes() {
+        int32_t total = 0;
+        for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
+            total += ((volatile HartCounts&)counts.forCPU(id)).live_bytes;
+        }
+        return total > 0 ? (uint32_t)total : 0;
+    }
+
+    // Caller holds profLock
+    static void update_peak() {
+        uint32_t live = live_bytes();
+        if (live > peak_live_bytes) {
+            peak_live_bytes = live;
+        }
+    }
+
+    void record_alloc(void* p, uint32_t bucket, size_t bytes, void* site) {
+        bool was = pit::disable_interrupts();
+        HartCounts& mine = counts.mine();
+        mine.allocs[bucket]++;
+        mine.alloc_bytes[bucket] += bytes;
+        mine.live_bytes += bytes;
+        bool sampled = mine.until_sample == 0;
+        mine.until_sample = sampled ? SAMPLE_EVERY - 1 : mine.until_sample - 1;
+        pit::restore_interrupts(was);
+        if (sampled) {
+            profLock.lock();
+            sample((uintptr_t)p, bytes, site);
+            update_peak();
+            profLock.unlock();
+        }
+    }
+
+    void record_free(void* p, uint32_t bucket, size_t bytes) {
+        bool was = pit::disable_interrupts();
+        HartCounts& mine = counts.mine();
+        mine.frees[bucket]++;
+        mine.free_bytes[bucket] += bytes;
+        mine.live_bytes -= bytes;
+        pit::restore_interrupts(was);
+        // The allocation was published to this thread after it was sampled, so its count is visible
+        if (filter[filter_of((uintptr_t)p)].get(MemoryOrder::RELAXED) != 0) {
+            profLock.lock();
+            unsample((uintptr_t)p);
+            profLock.unlock();
+        }
+    }
+
+    // Every sample so far becomes evictable once the table fills up
+    void checkpoint() {
+        profLock.lock();
+        epoch++;
+        epoch_samples = 0;
+        profLock.unlock();
+    }
+
+    struct SiteTotal {
+        void* address;
+        uint32_t count;
+        uint64_t bytes;
+    };
+
+    // Keeps the TOP_SITES heaviest entries of top sorted by bytes, returns the new length
+    static uint32_t insert_top(SiteTotal* top, uint32_t len, const SiteTotal& entry) {
+        uint32_t pos = len;
+        while (pos > 0 && top[pos - 1].bytes < entry.bytes) {
+            pos--;
+        }
+        if (pos == TOP_SITES) {
+            return len;
+        }
+        uint32_t last = len < TOP_SITES ? len : TOP_SITES - 1;
+        for (uint32_t i = last; i > pos; i--) {
+            top[i] = top[i - 1];
+        }
+        top[pos] = entry;
+        return len < TOP_SITES ? len + 1 : len;
+    }
+
+    static void print_sites(const SiteTotal* top, uint32_t len) {
+        for (uint32_t i = 0; i < len; i++) {
+            printf("heap:   site %x: ~%d allocations, ~%d bytes\n", top[i].address,
+                   top[i].count * SAMPLE_EVERY, (uint32_t)(top[i].bytes * SAMPLE_EVERY));
+        }
+    }
+
+    /**
+     * Lists the call sites of sampled allocations made since the last checkpoint that are still live
+     * Totals are gathered under profLock and printed after it is released
+     */
+    void leak_report() {
+        SiteTotal* per_site = new SiteTotal[SITE_SLOTS];
+        SiteTotal top[TOP_SITES];
+        uint32_t len = 0;
+        uint32_t leaked = 0;
+        profLock.lock();
+        uint32_t current = epoch;
+        for (uint32_t s = 0; s < SITE_SLOTS; s++) {
+            per_site[s] = SiteTotal{sites[s].address, 0, 0};
+        }
+        for (uint32_t i = 0; i < SAMPLE_SLOTS; i++) {
+            if (samples[i].ptr != 0 && samples[i].epoch == current) {
+                per_site[samples[i].site].count++;
+                per_site[samples[i].site].bytes += samples[i].bytes;
+                leaked++;
+            }
+        }
+        profLock.unlock();
+        for (uint32_t s = 0; s < SITE_SLOTS; s++) {
+            if (per_site[s].count > 0) {
+                len = insert_top(top, len, per_site[s]);
+            }
+        }
+        delete[] per_site;
+
+        printf("heap: leak report for epoch %d, ~%d allocations still live\n", current, leaked * SAMPLE_EVERY);
+        print_sites(top, len);
+    }
+
+    void dump() {
+        uint64_t live_total = 0;
+        for (uint32_t b = 0; b < NUM_BUCKETS; b++) {
+            uint32_t allocs = 0;
+            uint32_t frees = 0;
+            uint64_t live = 0;
+            for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
+                HartCounts& hart = counts.forCPU(id);
+                allocs += hart.allocs[b];
+                frees += hart.frees[b];
+                live += hart.alloc_bytes[b] - hart.free_bytes[b];
+            }
+            live_total += live;
+            if (allocs == 0) {
+                continue;
+            }
+            if (b == FIRST_FIT_BUCKET) {
+                printf("heap: first-fit:");
+            } else if (b == LARGE_BUCKET) {
+                printf("heap: large:");
+            } else {
+                printf("heap: %d bytes:", slab::class_size(b));
+            }
+            printf(" %d allocs, %d frees, %d bytes live\n", allocs, frees, (uint32_t)live);
+        }
+        profLock.lock();
+        update_peak();
+        uint32_t peak = peak_live_bytes;
+        profLock.unlock();
+        printf("heap: %d bytes live, peak ~%d bytes live\n", (uint32_t)live_total, peak);
+
+        size_t free_bytes;
+        size_t largest;
+        heap::free_extents(free_bytes, largest);
+        uint32_t fragmentation = free_bytes ? 100 - (uint32_t)((uint64_t)largest * 100 / free_bytes) : 0;
+        printf("heap: first-fit regions: %d bytes free, largest free extent %d bytes, %d%% fragmented\n",
+               free_bytes, largest, fragmentation);
+        pallocator::dump_stats();
+
+        SiteTotal top[TOP_SITES];
+        uint32_t len = 0;
+        profLock.lock();
+        for (uint32_t s = 0; s < SITE_SLOTS; s++) {
+            if (sites[s].samples > 0) {
+                len = insert_top(top, len, SiteTotal{sites[s].address, sites[s].samples, sites[s].bytes});
+            }
+        }
+        uint32_t evicted = evicted_samples;
+        uint32_t dropped = dropped_samples;
+        profLock.unlock();
+        printf("heap: heaviest call sites, %d older samples evicted, %d samples dropped:\n", evicted, dropped);
+        print_sites(top, len);
+    }
+};
\ No newline at end of file
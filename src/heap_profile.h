@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common/common.h"
+#include "slab.h"
+
+// Always-on heap profiling, cheap enough to leave running under load
+// Every allocation and free is counted by size bucket in per-HART counters, with no lock and no atomic
+// One allocation in SAMPLE_EVERY per HART is sampled with its call site, the return address into the
+// code that called new or malloc, and stays in a fixed table until it is freed or, once the table is
+// full, evicted to make room for a sample of a newer epoch. Frees check a small counting filter first,
+// so only frees of sampled allocations take the profile lock
+// Sampled figures are estimates, scaled up by SAMPLE_EVERY
+namespace heap_profile {
+    constexpr uint32_t SAMPLE_EVERY = 64;
+
+    // Slab size classes first, then the first-fit regions and the page-backed large path
+    constexpr uint32_t FIRST_FIT_BUCKET = slab::NUM_CLASSES;
+    constexpr uint32_t LARGE_BUCKET = slab::NUM_CLASSES + 1;
+    constexpr uint32_t NUM_BUCKETS = slab::NUM_CLASSES + 2;
+
+    // bytes is what the allocator set aside, the size class rather than the request
+    extern void record_alloc(void* p, uint32_t bucket, size_t bytes, void* site);
+    extern void record_free(void* p, uint32_t bucket, size_t bytes);
+
+    // Starts a new leak epoch, leak_report() lists sampled allocations made since and still live
+    extern void checkpoint();
+    extern void leak_report();
+    // Counts per size class, heaviest call sites, peak live bytes and pages, and fragmentation
+    extern void dump();
+};
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "sync/barrier.h"
 #include "sync/promise.h"
 #include "sync/shared.h"
+#include "sync/lockstat.h"
 #include "drivers/virtio-blk/virtio-blk.h"
 
 void busy_work(uint64_t iterations)
@@ -34,7 +35,7 @@ struct A {
 };
 
 void shared_ptr_test() {
-    SharedPtr<A> shared = SharedPtr<A>(new A(5));
+    SharedPtr<A> shared = make_shared<A>(5);
     Barrier *b = new Barrier(6);
     for (int i = 0; i < 5; i++) {
         threads::kthread([shared, b] {
@@ -55,7 +56,7 @@ void shared_ptr_test() {
 void kernel_main() {
     printf("START\n");
     int N = 10;
-    SharedPtr<Barrier> b = SharedPtr<Barrier>(new Barrier(N+1));
+    SharedPtr<Barrier> b = make_shared<Barrier>(N+1);
     for (int i = 0; i < N; i++) {
         threads::kthread([b, i, N]() mutable {
             char *buf = new char[512];
@@ -80,4 +81,7 @@ void kernel_main() {
         b->sync();
     }
     printf("DONE\n");
+#ifdef CONFIG_LOCKSTAT
+    lockstat::dump();
+#endif
 }
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "pallocator.h"
+#include "common/bits.h"
+#include "boot/smp.h"
+#include "boot/pit.h"
 
 namespace pallocator {
 
@@ -6,25 +9,113 @@ namespace pallocator {
 // Internal state
 // ==========================================================
 
+// Written into the first page of every free block
+struct FreeBlock {
+    FreeBlock* prev;
+    FreeBlock* next;
+};
+
+static const uint8_t FREE_HEAD = 0x80; // Set in the first page's entry of a free block, with its order
+static const uint32_t HOT_BATCH = 16;
+static const uint32_t HOT_HIGH = 4 * HOT_BATCH;
+
+// Free single pages owned by one HART, used by it with interrupts off
+// lock is uncontended except when another HART drains the list because the buddy lists ran dry
+struct HotPages {
+    SpinlockNoInterrupts lock;
+    FreeBlock* list;
+    uint32_t count;
+};
+
+static Spinlock pageLock;
 static paddr_t region_start = 0;     // physical start address of the managed area
 static uint32_t total_pages = 0;     // total number of pages in the region
-static uint32_t bitmap_size = 0;     // size of bitmap in bytes
-static uint8_t* bitmap = 0;          // pointer to bitmap in memory
+static uint32_t first_pfn = 0;       // page frame number of region_start
+static uint8_t* page_info = 0;       // FREE_HEAD | order for the first page of each free block, else 0
+static FreeBlock* free_lists[MAX_ORDER + 1];
+static uint32_t free_counts[MAX_ORDER + 1];
+static uint32_t nonempty_orders = 0;  // bit k is set while free_lists[k] is non-empty
+static uint32_t free_page_count = 0;
+static uint32_t usable_pages = 0;     // pages not taken by page_info
+static uint32_t peak_used_pages = 0;
+static smp::PerCPU<HotPages> hot;
 
 // ==========================================================
 // Helper functions (no stdlib)
 // ==========================================================
 
-static inline void set_bit(uint32_t bit_index) {
-    bitmap[bit_index / 8] |= (1 << (bit_index % 8));
+static inline uint32_t index_of(paddr_t p) {
+    return (p - region_start) / PAGE_SIZE;
 }
 
-static inline void clear_bit(uint32_t bit_index) {
-    bitmap[bit_index / 8] &= ~(1 << (bit_index % 8));
+static inline paddr_t addr_of(uint32_t index) {
+    return region_start + index * PAGE_SIZE;
 }
 
-static inline uint32_t test_bit(uint32_t bit_index) {
-    return (bitmap[bit_index / 8] >> (bit_index % 8)) & 1;
+// Buddies are found by page frame number so blocks are aligned to their size in physical memory
+static inline uint32_t buddy_of(uint32_t index, uint32_t order) {
+    return ((first_pfn + index) ^ (1u << order)) - first_pfn;
+}
+
+static void list_push(uint32_t index, uint32_t order) {
+    FreeBlock* block = (FreeBlock*) addr_of(index);
+    block->prev = 0;
+    block->next = free_lists[order];
+    if (free_lists[order])
+        free_lists[order]->prev = block;
+    free_lists[order] = block;
+    free_counts[order]++;
+    nonempty_orders |= 1u << order;
+    page_info[index] = FREE_HEAD | order;
+}
+
+static void list_remove(uint32_t index, uint32_t order) {
+    FreeBlock* block = (FreeBlock*) addr_of(index);
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        free_lists[order] = block->next;
+    if (block->next)
+        block->next->prev = block->prev;
+    if (--free_counts[order] == 0)
+        nonempty_orders &= ~(1u << order);
+    page_info[index] = 0;
+}
+
+// Caller holds pageLock
+static void free_block(uint32_t index, uint32_t order) {
+    free_page_count += 1u << order;
+    while (order < MAX_ORDER) {
+        uint32_t buddy = buddy_of(index, order);
+        if (buddy >= total_pages || page_info[buddy] != (FREE_HEAD | order))
+            break;
+        list_remove(buddy, order);
+        if (buddy < index)
+            index = buddy;
+        order++;
+    }
+    list_push(index, order);
+}
+
+// Caller holds pageLock, returns the index of a block of the given order or -1
+static int32_t take_block(uint32_t order) {
+    // smallest non-empty order that is large enough, in one step
+    uint32_t usable = nonempty_orders & ~((1u << order) - 1);
+    if (!usable)
+        return -1;
+    uint32_t found = bits::ctz32(usable);
+
+    uint32_t index = index_of((paddr_t) free_lists[found]);
+    list_remove(index, found);
+    // split, keeping the lower half and freeing the upper one
+    while (found > order) {
+        found--;
+        list_push(index + (1u << found), found);
+    }
+    free_page_count -= 1u << order;
+    if (usable_pages - free_page_count > peak_used_pages)
+        peak_used_pages = usable_pages - free_page_count;
+    return index;
 }
 
 // ==========================================================
@@ -32,56 +123,191 @@ static inline uint32_t test_bit(uint32_t bit_index) {
 // ==========================================================
 
 void init(paddr_t start, size_t size) {
+    pageLock = {};
+    pageLock.set_name("pallocator");
+    for (uint32_t id = 0; id < smp::MAX_HARTS; id++)
+        hot.forCPU(id).lock.set_name("pallocator hot");
     region_start = start;
+    first_pfn = start / PAGE_SIZE;
 
     // how many pages we can manage
     total_pages = size / PAGE_SIZE;
 
-    // bitmap size in bytes (round up)
-    bitmap_size = (total_pages + 7) / 8;
+    // place the page info table at the start of the region and never hand out its pages
+    page_info = (uint8_t*) start;
+    for (uint32_t i = 0; i < total_pages; i++)
+        page_info[i] = 0;
+    uint32_t info_pages = (total_pages + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    for (uint32_t order = 0; order <= MAX_ORDER; order++) {
+        free_lists[order] = 0;
+        free_counts[order] = 0;
+    }
+    nonempty_orders = 0;
+    free_page_count = 0;
 
-    // place bitmap at start of the region
-    bitmap = (uint8_t*) start;
+    // carve the rest into the largest aligned blocks that fit
+    uint32_t index = info_pages;
+    while (index < total_pages) {
+        uint32_t order = MAX_ORDER;
+        while (((first_pfn + index) & ((1u << order) - 1)) != 0 || index + (1u << order) > total_pages)
+            order--;
+        list_push(index, order);
+        free_page_count += 1u << order;
+        index += 1u << order;
+    }
+    usable_pages = free_page_count;
+    peak_used_pages = 0;
+}
 
-    // clear bitmap (mark all pages free)
-    for (uint32_t i = 0; i < bitmap_size; i++)
-        bitmap[i] = 0;
+// ==========================================================
+// Allocate 2^order contiguous pages
+// ==========================================================
 
-    // skip over the bitmap itself so we don't allocate it
-    uint32_t bitmap_pages = (bitmap_size + PAGE_SIZE - 1) / PAGE_SIZE;
-    for (uint32_t i = 0; i < bitmap_pages; i++)
-        set_bit(i);
+paddr_t alloc_pages(uint32_t order) {
+    ASSERT(order <= MAX_ORDER);
+    pageLock.lock();
+    int32_t index = take_block(order);
+    pageLock.unlock();
+    if (index < 0) {
+        // pages sitting on hot lists may be what keeps a block from merging
+        drain_hot_pages();
+        pageLock.lock();
+        index = take_block(order);
+        pageLock.unlock();
+    }
+    return index < 0 ? 0 : addr_of(index);
 }
 
 // ==========================================================
-// Allocate one 4 KiB page
+// Allocate and free single pages through the hot lists
 // ==========================================================
 
 paddr_t alloc_page() {
-    for (uint32_t i = 0; i < total_pages; i++) {
-        if (!test_bit(i)) {
-            set_bit(i);
-            return region_start + (i * PAGE_SIZE);
+    bool was = pit::disable_interrupts();
+    HotPages& mine = hot.mine();
+    mine.lock.lock();
+    if (!mine.list) {
+        pageLock.lock();
+        for (uint32_t i = 0; i < HOT_BATCH; i++) {
+            int32_t index = take_block(0);
+            if (index < 0)
+                break;
+            FreeBlock* page = (FreeBlock*) addr_of(index);
+            page->next = mine.list;
+            mine.list = page;
+            mine.count++;
         }
+        pageLock.unlock();
     }
+    FreeBlock* page = mine.list;
+    if (page) {
+        mine.list = page->next;
+        mine.count--;
+    }
+    mine.lock.unlock();
+    pit::restore_interrupts(was);
+    if (!page) {
+        // the buddy lists are empty, but other HARTs may still hold hot pages
+        return alloc_pages(0);
+    }
+    return (paddr_t) page;
+}
 
-    // no free pages
-    return 0;
+// Caller has interrupts off and holds mine.lock, moves up to n pages from mine back to the buddy lists
+static void drain(HotPages& mine, uint32_t n) {
+    pageLock.lock();
+    for (uint32_t i = 0; i < n && mine.list; i++) {
+        FreeBlock* page = mine.list;
+        mine.list = page->next;
+        mine.count--;
+        free_block(index_of((paddr_t) page), 0);
+    }
+    pageLock.unlock();
+}
+
+void dealloc_pages(paddr_t p) {
+    if (p < region_start || index_of(p) >= total_pages)
+        return;
+
+    bool was = pit::disable_interrupts();
+    HotPages& mine = hot.mine();
+    mine.lock.lock();
+    FreeBlock* page = (FreeBlock*) p;
+    page->next = mine.list;
+    mine.list = page;
+    if (++mine.count > HOT_HIGH)
+        drain(mine, HOT_BATCH);
+    mine.lock.unlock();
+    pit::restore_interrupts(was);
+}
+
+void drain_hot_pages() {
+    bool was = pit::disable_interrupts();
+    for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
+        HotPages& hart = hot.forCPU(id);
+        hart.lock.lock();
+        drain(hart, hart.count);
+        hart.lock.unlock();
+    }
+    pit::restore_interrupts(was);
 }
 
 // ==========================================================
-// Deallocate one 4 KiB page
+// Free 2^order contiguous pages
 // ==========================================================
 
-void dealloc_pages(paddr_t p) {
+void free_pages(paddr_t p, uint32_t order) {
+    ASSERT(order <= MAX_ORDER);
     if (p < region_start)
         return;
 
-    uint32_t index = (p - region_start) / PAGE_SIZE;
+    uint32_t index = index_of(p);
     if (index >= total_pages)
         return;
 
-    clear_bit(index);
+    pageLock.lock();
+    ASSERT(page_info[index] == 0); // double free
+    free_block(index, order);
+    pageLock.unlock();
+}
+
+// ==========================================================
+// Statistics
+// ==========================================================
+
+void get_stats(Stats& stats) {
+    pageLock.lock();
+    stats.total_pages = total_pages;
+    stats.free_pages = free_page_count;
+    stats.largest_free_order = 0;
+    stats.peak_used_pages = peak_used_pages;
+    for (uint32_t order = 0; order <= MAX_ORDER; order++) {
+        stats.free_blocks[order] = free_counts[order];
+        if (free_counts[order])
+            stats.largest_free_order = order;
+    }
+    pageLock.unlock();
+    // racy, each list only changes under its own HART
+    stats.hot_pages = 0;
+    for (uint32_t id = 0; id < smp::MAX_HARTS; id++)
+        stats.hot_pages += hot.forCPU(id).count;
+}
+
+// External fragmentation is the share of free pages outside blocks of the largest free order
+void dump_stats() {
+    Stats stats;
+    get_stats(stats);
+    uint32_t largest = stats.free_pages ? 1u << stats.largest_free_order : 0;
+    uint32_t in_largest = largest * stats.free_blocks[stats.largest_free_order];
+    uint32_t fragmentation = stats.free_pages ? 100 - in_largest * 100 / stats.free_pages : 0;
+    printf("pallocator: %d of %d pages free, %d more on hot lists, largest free block %d pages, %d%% fragmented\n",
+           stats.free_pages, stats.total_pages, stats.hot_pages, largest, fragmentation);
+    printf("pallocator: peak %d pages in use\n", stats.peak_used_pages);
+    printf("pallocator: free blocks by order:");
+    for (uint32_t order = 0; order <= MAX_ORDER; order++)
+        printf(" %d", stats.free_blocks[order]);
+    printf("\n");
 }
 
-} // namespace pallocator
+} // namespace pallocator
\ No newline at end of file
@@ -2,9 +2,36 @@
 #include "common/common.h"
 #include "sync/spinlock.h"
 
+// Binary buddy allocator for physical pages
+// A block of order k is 2^k contiguous pages aligned to its own size. Freeing a block merges it with
+// its buddy for as long as the buddy is free too. Buddy operations take pageLock and are O(MAX_ORDER)
+// Single pages go through per-HART hot lists first, after Linux's per-cpu page lists. alloc_page and
+// dealloc_pages only touch this HART's list, and move HOT_BATCH pages to or from the buddy lists when
+// it runs dry or grows past HOT_HIGH. An allocation the buddy lists can't satisfy drains every HART's
+// hot list and tries again, so pages freed on one HART are never stranded there
 namespace pallocator {
     static const uint32_t PAGE_SIZE = 4096;
+    static const uint32_t MAX_ORDER = 10; // 4 MiB blocks
+
+    struct Stats {
+        uint32_t total_pages;
+        uint32_t free_pages;
+        uint32_t free_blocks[MAX_ORDER + 1]; // Free blocks of each order
+        uint32_t largest_free_order; // Only meaningful if free_pages > 0
+        uint32_t hot_pages; // Free single pages held by HARTs, not counted in free_pages
+        uint32_t peak_used_pages; // Most pages ever out of the buddy lists at once, hot pages included
+    };
+
+    // Single page from this HART's hot list, or 0 if neither the buddy lists nor any hot list has one
     paddr_t alloc_page();
     void dealloc_pages(paddr_t p);
+    // Returns every HART's hot pages to the buddy lists so they can merge
+    void drain_hot_pages();
+    // Returns 2^order contiguous pages aligned to 2^order pages, or 0 if no block is large enough
+    paddr_t alloc_pages(uint32_t order);
+    // p and order must match an alloc_pages call
+    void free_pages(paddr_t p, uint32_t order);
+    void get_stats(Stats& stats);
+    void dump_stats();
     void init(paddr_t start, size_t size);
 };
\ No newline at end of file
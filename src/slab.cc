@@ -0,0 +1,226 @@
+#include "slab.h"
+#include "pallocator.h"
+#include "boot/smp.h"
+#include "boot/pit.h"
+#include "sync/spinlock.h"
+
+namespace slab {
+
+    constexpr uint32_t CLASS_SIZES[NUM_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256, 320, 384, 512, 640, 768, 1024};
+    constexpr uint32_t GRANULE = 16; // Every class is a multiple of this, so objects stay 16-byte aligned
+    constexpr uint32_t MAX_BATCH = 16; // Objects moved between a HART and the slabs at a time
+    constexpr uint32_t SLAB_MAGIC = 0x51AB51AB;
+
+    // Free objects link through their first word
+    struct Object {
+        Object* next;
+    };
+
+    // Lives at the start of every slab page
+    struct Slab {
+        uint32_t magic;
+        uint32_t class_index;
+        uint32_t inuse; // Objects handed out to HARTs
+        Object* free; // Objects still in the slab
+        Slab* prev; // Partial list links, only valid while free != nullptr
+        Slab* next;
+    };
+
+    constexpr uint32_t HEADER_SIZE = (sizeof(Slab) + GRANULE - 1) / GRANULE * GRANULE;
+
+    struct SizeClass {
+        Spinlock lock;
+        Slab* partial; // Slabs with at least one free object, protected by lock
+        uint32_t empty_slabs; // Partial slabs with nothing handed out, one is kept to absorb churn
+        uint32_t size;
+        uint32_t per_slab;
+        uint32_t batch;
+    };
+
+    struct HartCache {
+        Object* lists[NUM_CLASSES];
+        uint32_t counts[NUM_CLASSES];
+    };
+
+    SizeClass classes[NUM_CLASSES];
+    uint8_t class_for[MAX_SIZE / GRANULE + 1]; // Size class of a request, indexed by size rounded up to GRANULE
+    smp::PerCPU<HartCache> harts;
+    bool initialized;
+
+    void init() {
+        uint32_t c = 0;
+        for (uint32_t i = 0; i <= MAX_SIZE / GRANULE; i++) {
+            while (CLASS_SIZES[c] < i * GRANULE) {
+                c++;
+            }
+            class_for[i] = c;
+        }
+        for (c = 0; c < NUM_CLASSES; c++) {
+            classes[c].lock = {};
+            classes[c].lock.set_name("slab");
+            classes[c].partial = nullptr;
+            classes[c].empty_slabs = 0;
+            classes[c].size = CLASS_SIZES[c];
+            classes[c].per_slab = (pallocator::PAGE_SIZE - HEADER_SIZE) / CLASS_SIZES[c];
+            classes[c].batch = classes[c].per_slab < MAX_BATCH ? classes[c].per_slab : MAX_BATCH;
+        }
+        initialized = true;
+    }
+
+    bool ready() {
+        return initialized;
+    }
+
+    static Slab* slab_of(void* p) {
+        return (Slab*)((uintptr_t)p & ~(uintptr_t)(pallocator::PAGE_SIZE - 1));
+    }
+
+    static void partial_push(SizeClass& sc, Slab* slab) {
+        slab->prev = nullptr;
+        slab->next = sc.partial;
+        if (sc.partial != nullptr) {
+            sc.partial->prev = slab;
+        }
+        sc.partial = slab;
+    }
+
+    static void partial_remove(SizeClass& sc, Slab* slab) {
+        if (slab->prev != nullptr) {
+            slab->prev->next = slab->next;
+        } else {
+            sc.partial = slab->next;
+        }
+        if (slab->next != nullptr) {
+            slab->next->prev = slab->prev;
+        }
+    }
+
+    // Caller holds sc.lock, returns nullptr if pallocator is out of pages
+    static Slab* new_slab(uint32_t c) {
+        SizeClass& sc = classes[c];
+        paddr_t page = pallocator::alloc_page();
+        if (page == 0) {
+            return nullptr;
+        }
+        Slab* slab = (Slab*)page;
+        slab->magic = SLAB_MAGIC;
+        slab->class_index = c;
+        slab->inuse = 0;
+        slab->free = nullptr;
+        uint8_t* base = (uint8_t*)page + HEADER_SIZE;
+        for (uint32_t i = sc.per_slab; i > 0; i--) {
+            Object* obj = (Object*)(base + (i - 1) * sc.size);
+            obj->next = slab->free;
+            slab->free = obj;
+        }
+        partial_push(sc, slab);
+        sc.empty_slabs++;
+        return slab;
+    }
+
+    // Moves up to a batch of objects from the slabs onto cache's list for class c
+    // Interrupts are off
+    static void refill(HartCache& cache, uint32_t c) {
+        SizeClass& sc = classes[c];
+        sc.lock.lock();
+        for (uint32_t moved = 0; moved < sc.batch; moved++) {
+            Slab* slab = sc.partial != nullptr ? sc.partial : new_slab(c);
+            if (slab == nullptr) {
+                break;
+            }
+            if (slab->inuse++ == 0) {
+                sc.empty_slabs--;
+            }
+            Object* obj = slab->free;
+            slab->free = obj->next;
+            if (slab->free == nullptr) {
+                partial_remove(sc, slab);
+            }
+            obj->next = cache.lists[c];
+            cache.lists[c] = obj;
+            cache.counts[c]++;
+        }
+        sc.lock.unlock();
+    }
+
+    // Returns a batch of objects from cache's list for class c to their slabs
+    // Wholly free slabs beyond the first go back to pallocator. Interrupts are off
+    static void drain(HartCache& cache, uint32_t c) {
+        SizeClass& sc = classes[c];
+        Slab* released = nullptr;
+        sc.lock.lock();
+        for (uint32_t moved = 0; moved < sc.batch; moved++) {
+            Object* obj = cache.lists[c];
+            cache.lists[c] = obj->next;
+            cache.counts[c]--;
+            Slab* slab = slab_of(obj);
+            if (slab->free == nullptr) {
+                partial_push(sc, slab);
+            }
+            obj->next = slab->free;
+            slab->free = obj;
+            if (--slab->inuse == 0) {
+                if (sc.empty_slabs == 0) {
+                    sc.empty_slabs++;
+                } else {
+                    partial_remove(sc, slab);
+                    slab->next = released;
+                    released = slab;
+                }
+            }
+        }
+        sc.lock.unlock();
+        while (released != nullptr) {
+            Slab* next = released->next;
+            released->magic = 0;
+            pallocator::dealloc_pages((paddr_t)released);
+            released = next;
+        }
+    }
+
+    uint32_t class_index(size_t size) {
+        return class_for[(size + GRANULE - 1) / GRANULE];
+    }
+
+    uint32_t class_of(void* p) {
+        return slab_of(p)->class_index;
+    }
+
+    uint32_t class_size(uint32_t c) {
+        return CLASS_SIZES[c];
+    }
+
+    void* malloc(size_t size) {
+        if (size > MAX_SIZE) {
+            return nullptr;
+        }
+        uint32_t c = class_index(size);
+        bool was = pit::disable_interrupts();
+        HartCache& cache = harts.mine();
+        if (cache.lists[c] == nullptr) {
+            refill(cache, c);
+        }
+        Object* obj = cache.lists[c];
+        if (obj != nullptr) {
+            cache.lists[c] = obj->next;
+            cache.counts[c]--;
+        }
+        pit::restore_interrupts(was);
+        return obj;
+    }
+
+    void free(void* p) {
+        Slab* slab = slab_of(p);
+        ASSERT(slab->magic == SLAB_MAGIC);
+        uint32_t c = slab->class_index;
+        bool was = pit::disable_interrupts();
+        HartCache& cache = harts.mine();
+        Object* obj = (Object*)p;
+        obj->next = cache.lists[c];
+        cache.lists[c] = obj;
+        if (++cache.counts[c] >= 2 * classes[c].batch) {
+            drain(cache, c);
+        }
+        pit::restore_interrupts(was);
+    }
+};
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common/common.h"
+
+// Segregated size-class slab allocator for small heap allocations, behind heap::malloc and heap::free
+// Each size class carves pallocator pages into equal objects. A slab's header sits at the start of
+// its page, so free finds it by masking the pointer. HARTs keep a free list per class and move
+// objects to and from the slabs in batches under the class lock, so malloc and free are O(1)
+// and usually take no lock
+namespace slab {
+    constexpr size_t MAX_SIZE = 1024; // Larger requests go to the first-fit heap
+    constexpr uint32_t NUM_CLASSES = 14;
+
+    extern void init();
+    extern bool ready();
+    // Returns nullptr if size is too large or no page is left
+    extern void* malloc(size_t size);
+    // p must come from slab::malloc
+    extern void free(void* p);
+    // Size class slab::malloc(size) allocates from, size <= MAX_SIZE
+    extern uint32_t class_index(size_t size);
+    // Size class of an object from slab::malloc
+    extern uint32_t class_of(void* p);
+    extern uint32_t class_size(uint32_t c);
+};
\ No newline at end of file
@@ -1 +1,45 @@
-#include "atomic.h"
\ No newline at end of file
+#include "atomic.h"
+#include "../common/common.h"
+#include "../boot/pit.h"
+
+namespace atomic {
+
+    constexpr uint32_t STRIPE_BITS = 4;
+
+    struct alignas(CACHE_LINE_SIZE) Stripe {
+        volatile uint32_t locked;
+    };
+
+    Stripe stripes[1 << STRIPE_BITS];
+
+    static Stripe* stripe_for(const volatile void* addr) {
+        uint32_t hash = ((uint32_t)(uintptr_t)addr >> 3) * 2654435761u;
+        return &stripes[hash >> (32 - STRIPE_BITS)];
+    }
+
+    bool lock_stripe(const volatile void* addr) {
+        Stripe* stripe = stripe_for(addr);
+        bool was = pit::disable_interrupts();
+        while (true) {
+            uint32_t old_value;
+            __asm__ volatile(
+                "amoswap.w.aq %0, %1, (%2)\n"
+                : "=r"(old_value)
+                : "r"(1), "r"(&stripe->locked)
+                : "memory");
+            if (old_value == 0) {
+                return was;
+            }
+            while (stripe->locked != 0) {
+                // Spin on a plain load so waiters don't keep stealing the cache line
+            }
+        }
+    }
+
+    void unlock_stripe(const volatile void* addr, bool was) {
+        Stripe* stripe = stripe_for(addr);
+        fence_release();
+        stripe->locked = 0;
+        pit::restore_interrupts(was);
+    }
+};
\ No newline at end of file
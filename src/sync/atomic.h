@@ -1,107 +1,243 @@
 #pragma once
 
-// Atomic class made by Copilot
+// Memory orders for Atomic<T> operations, with the same meaning as std::memory_order
+enum class MemoryOrder {
+    RELAXED, // Atomicity only, no ordering
+    ACQUIRE, // Later loads and stores stay after this operation
+    RELEASE, // Earlier loads and stores stay before this operation
+    ACQ_REL, // Both, for read-modify-write operations
+    SEQ_CST  // Single total order across all SEQ_CST operations (default)
+};
+
+// Memory fences
+namespace atomic {
+    // Orders all earlier loads and stores before all later loads and stores
+    inline void fence() {
+        __asm__ volatile("fence rw, rw\n" ::: "memory");
+    }
+
+    // Orders earlier loads before all later loads and stores
+    inline void fence_acquire() {
+        __asm__ volatile("fence r, rw\n" ::: "memory");
+    }
+
+    // Orders all earlier loads and stores before later stores
+    inline void fence_release() {
+        __asm__ volatile("fence rw, w\n" ::: "memory");
+    }
+
+    // Atomic<T> for anything but 32-bit T is serialized through a small table of striped spinlocks
+    // keyed by address, since rv32 only has word-sized AMOs and LR/SC
+    // Interrupts are disabled while a stripe is held, so the critical section can't be preempted
+    extern bool lock_stripe(const volatile void* addr);
+    extern void unlock_stripe(const volatile void* addr, bool was);
+};
+
+// Emits the AMO instruction variant for order: insn, insn.aq, insn.rl or insn.aqrl
+#define ATOMIC_AMO_W(insn, order, result, operand, addr)                               \
+    do {                                                                               \
+        switch (order) {                                                               \
+            case MemoryOrder::RELAXED:                                                 \
+                __asm__ volatile(insn ".w %0, %1, (%2)\n"                              \
+                    : "=r"(result) : "r"(operand), "r"(addr) : "memory");              \
+                break;                                                                 \
+            case MemoryOrder::ACQUIRE:                                                 \
+                __asm__ volatile(insn ".w.aq %0, %1, (%2)\n"                           \
+                    : "=r"(result) : "r"(operand), "r"(addr) : "memory");              \
+                break;                                                                 \
+            case MemoryOrder::RELEASE:                                                 \
+                __asm__ volatile(insn ".w.rl %0, %1, (%2)\n"                           \
+                    : "=r"(result) : "r"(operand), "r"(addr) : "memory");              \
+                break;                                                                 \
+            default:                                                                   \
+                __asm__ volatile(insn ".w.aqrl %0, %1, (%2)\n"                         \
+                    : "=r"(result) : "r"(operand), "r"(addr) : "memory");              \
+                break;                                                                 \
+        }                                                                              \
+    } while (0)
+
+// Atomic class made by Copilot, reworked for memory orders and non 32-bit types
+// 32-bit loads and stores are plain lw/sw with the fences the order needs (RISC-V ISA manual, Table A.6),
+// read-modify-writes are AMOs or LR/SC with .aq/.rl bits. Other sizes go through the striped spinlocks
+// Every operation defaults to SEQ_CST, hot paths should ask for the weakest order that is correct
 template <typename T>
 class Atomic {
     T value;
 
+    static constexpr bool NATIVE = sizeof(T) == 4;
+
 public:
-    Atomic(T value = 0) : value(value) {}
+    constexpr Atomic(T value = 0) : value(value) {}
 
     // Load value atomically
-    T get() const {
+    T get(MemoryOrder order = MemoryOrder::SEQ_CST) const {
         T result;
-        if constexpr (sizeof(T) == 4) {
-            // For 32-bit types, use lr.w (load-reserved word) to ensure atomicity
-            __asm__ volatile(
-                "lr.w %0, (%1)\n"
-                : "=r"(result)
-                : "r"(&value)
-                : "memory");
+        if constexpr (NATIVE) {
+            if (order == MemoryOrder::SEQ_CST) {
+                atomic::fence();
+            }
+            __asm__ volatile("lw %0, 0(%1)\n" : "=r"(result) : "r"(&value) : "memory");
+            if (order != MemoryOrder::RELAXED) {
+                atomic::fence_acquire();
+            }
         } else {
-            // For other types, fall back to volatile read
+            bool was = atomic::lock_stripe(&value);
             result = value;
+            atomic::unlock_stripe(&value, was);
         }
         return result;
     }
 
     // Store value atomically
-    void set(T newval) {
-        if constexpr (sizeof(T) == 4) {
-            // For 32-bit types, use amoswap.w (atomic swap word) to store atomically
-            __asm__ volatile(
-                "amoswap.w zero, %0, (%1)\n"
-                :
-                : "r"(newval), "r"(&value)
-                : "memory");
+    void set(T newval, MemoryOrder order = MemoryOrder::SEQ_CST) {
+        if constexpr (NATIVE) {
+            if (order != MemoryOrder::RELAXED) {
+                atomic::fence_release();
+            }
+            __asm__ volatile("sw %0, 0(%1)\n" : : "r"(newval), "r"(&value) : "memory");
         } else {
-            // For other types, fall back to volatile write
+            bool was = atomic::lock_stripe(&value);
             value = newval;
+            atomic::unlock_stripe(&value, was);
         }
     }
 
     // Fetch-add: atomically add to value and return old value
-    T fetch_add(T delta = 1) {
+    T fetch_add(T delta = 1, MemoryOrder order = MemoryOrder::SEQ_CST) {
         T old_value;
-        if constexpr (sizeof(T) == 4) {
-            // For 32-bit types, use amoadd.w (atomic add word)
-            __asm__ volatile(
-                "amoadd.w %0, %1, (%2)\n"
-                : "=r"(old_value)
-                : "r"(delta), "r"(&value)
-                : "memory");
+        if constexpr (NATIVE) {
+            ATOMIC_AMO_W("amoadd", order, old_value, delta, &value);
         } else {
-            // For other types, fall back to non-atomic (but this is a limitation)
+            bool was = atomic::lock_stripe(&value);
             old_value = value;
-            value += delta;
+            value = old_value + delta;
+            atomic::unlock_stripe(&value, was);
         }
         return old_value;
     }
 
     // Add-fetch: atomically add to value and return new value
-    T add_fetch(T delta = 1) {
-        if constexpr (sizeof(T) == 4) {
-            // For 32-bit types, use amoadd.w and calculate new value
-            T new_value;
-            __asm__ volatile(
-                "amoadd.w %0, %1, (%2)\n"
-                : "=r"(new_value)
-                : "r"(delta), "r"(&value)
-                : "memory");
-            // amoadd.w returns the old value, so add delta to get the new value
-            return new_value + delta;
+    T add_fetch(T delta = 1, MemoryOrder order = MemoryOrder::SEQ_CST) {
+        return fetch_add(delta, order) + delta;
+    }
+
+    // Exchange: atomically store newval and return the old value
+    T exchange(T newval, MemoryOrder order = MemoryOrder::SEQ_CST) {
+        T old_value;
+        if constexpr (NATIVE) {
+            ATOMIC_AMO_W("amoswap", order, old_value, newval, &value);
         } else {
-            // For other types, fall back to non-atomic
-            return (value += delta);
+            bool was = atomic::lock_stripe(&value);
+            old_value = value;
+            value = newval;
+            atomic::unlock_stripe(&value, was);
         }
+        return old_value;
+    }
+
+    // Fetch-and: atomically and mask into value and return the old value
+    T fetch_and(T mask, MemoryOrder order = MemoryOrder::SEQ_CST) {
+        T old_value;
+        if constexpr (NATIVE) {
+            ATOMIC_AMO_W("amoand", order, old_value, mask, &value);
+        } else {
+            bool was = atomic::lock_stripe(&value);
+            old_value = value;
+            value = old_value & mask;
+            atomic::unlock_stripe(&value, was);
+        }
+        return old_value;
+    }
+
+    // Fetch-or: atomically or mask into value and return the old value
+    T fetch_or(T mask, MemoryOrder order = MemoryOrder::SEQ_CST) {
+        T old_value;
+        if constexpr (NATIVE) {
+            ATOMIC_AMO_W("amoor", order, old_value, mask, &value);
+        } else {
+            bool was = atomic::lock_stripe(&value);
+            old_value = value;
+            value = old_value | mask;
+            atomic::unlock_stripe(&value, was);
+        }
+        return old_value;
     }
 
     // Compare-and-swap: atomically compare and swap if equal
     // Returns true if the swap was successful, false otherwise
-    bool compare_and_swap(T expected, T newval) {
-        if constexpr (sizeof(T) == 4) {
-            // Use lr.w/sc.w for compare-and-swap
+    // order applies to the successful swap, a failed compare is relaxed
+    bool compare_and_swap(T expected, T newval, MemoryOrder order = MemoryOrder::SEQ_CST) {
+        if constexpr (NATIVE) {
             T result;
-            __asm__ volatile(
-                "0: lr.w %0, (%1)\n"
-                "   bne %0, %2, 1f\n"     // if value != expected, skip store
-                "   sc.w %0, %3, (%1)\n"  // try to store newval
-                "   bnez %0, 0b\n"        // if sc failed, retry
-                "   li %0, 1\n"           // success: result = 1
-                "   j 2f\n"
-                "1: li %0, 0\n"           // failure: result = 0
-                "2:\n"
-                : "=&r"(result)
-                : "r"(&value), "r"(expected), "r"(newval)
-                : "memory");
+            switch (order) {
+                case MemoryOrder::RELAXED:
+                    __asm__ volatile(
+                        "0: lr.w %0, (%1)\n"
+                        "   bne %0, %2, 1f\n"     // if value != expected, skip store
+                        "   sc.w %0, %3, (%1)\n"  // try to store newval
+                        "   bnez %0, 0b\n"        // if sc failed, retry
+                        "   li %0, 1\n"           // success: result = 1
+                        "   j 2f\n"
+                        "1: li %0, 0\n"           // failure: result = 0
+                        "2:\n"
+                        : "=&r"(result)
+                        : "r"(&value), "r"(expected), "r"(newval)
+                        : "memory");
+                    break;
+                case MemoryOrder::ACQUIRE:
+                    __asm__ volatile(
+                        "0: lr.w.aq %0, (%1)\n"
+                        "   bne %0, %2, 1f\n"
+                        "   sc.w %0, %3, (%1)\n"
+                        "   bnez %0, 0b\n"
+                        "   li %0, 1\n"
+                        "   j 2f\n"
+                        "1: li %0, 0\n"
+                        "2:\n"
+                        : "=&r"(result)
+                        : "r"(&value), "r"(expected), "r"(newval)
+                        : "memory");
+                    break;
+                case MemoryOrder::RELEASE:
+                    __asm__ volatile(
+                        "0: lr.w %0, (%1)\n"
+                        "   bne %0, %2, 1f\n"
+                        "   sc.w.rl %0, %3, (%1)\n"
+                        "   bnez %0, 0b\n"
+                        "   li %0, 1\n"
+                        "   j 2f\n"
+                        "1: li %0, 0\n"
+                        "2:\n"
+                        : "=&r"(result)
+                        : "r"(&value), "r"(expected), "r"(newval)
+                        : "memory");
+                    break;
+                default:
+                    __asm__ volatile(
+                        "0: lr.w.aqrl %0, (%1)\n"
+                        "   bne %0, %2, 1f\n"
+                        "   sc.w.rl %0, %3, (%1)\n"
+                        "   bnez %0, 0b\n"
+                        "   li %0, 1\n"
+                        "   j 2f\n"
+                        "1: li %0, 0\n"
+                        "2:\n"
+                        : "=&r"(result)
+                        : "r"(&value), "r"(expected), "r"(newval)
+                        : "memory");
+                    break;
+            }
             return result;
         } else {
-            // For other types, fall back to non-atomic CAS
-            if (value == expected) {
+            bool was = atomic::lock_stripe(&value);
+            bool swapped = value == expected;
+            if (swapped) {
                 value = newval;
-                return true;
             }
-            return false;
+            atomic::unlock_stripe(&value, was);
+            return swapped;
         }
     }
-};
\ No newline at end of file
+};
+
+#undef ATOMIC_AMO_W
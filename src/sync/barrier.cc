@@ -1,34 +1,106 @@
 #include "barrier.h"
+#include "parking_lot.h"
 
-Barrier::Barrier(int n) : count(0), count_sync(1), turnstile(0), turnstile_sync(1) {
+Barrier::Barrier(int n) : count(0), generation(0), mutex(), all_arrived() {
     ASSERT(n > 0);
     this->n = n;
 }
 
 void Barrier::sync() {
-    count_sync.down();
+    mutex.lock();
+    uint32_t my_generation = generation;
     count = count + 1;
     if (count == n) {
-        turnstile_sync.down(); // Trap the threads until all threads make it through the turnstile
-        turnstile.up();
-        count_sync.up();
+        // Last to arrive starts the next phase and releases everyone
+        count = 0;
+        generation = generation + 1;
+        all_arrived.notify_all();
     } else {
-        count_sync.up();
+        while (my_generation == generation) {
+            all_arrived.wait(mutex);
+        }
     }
+    mutex.unlock();
+}
+
+void BarrierPhase::wait(uint32_t my_phase) {
+    for (uint32_t i = 0; i < SPIN_LIMIT; i++) {
+        if (phase.get(MemoryOrder::ACQUIRE) != my_phase) {
+            return;
+        }
+    }
+    while (phase.get(MemoryOrder::ACQUIRE) == my_phase) {
+        // The flag is set under the bucket lock, so an advance() that takes it unparks after we are queued,
+        // even one for an earlier phase. SEQ_CST on both sides: either advance() sees the flag or we see
+        // the new phase
+        parking_lot::park(&phase, [this, my_phase] {
+            sleepers.set(1);
+            return phase.get() == my_phase;
+        });
+    }
+}
+
+void BarrierPhase::advance(uint32_t my_phase) {
+    phase.set(my_phase + 1);
+    if (sleepers.exchange(0) != 0) {
+        parking_lot::unpark_all(&phase);
+    }
+}
 
-    turnstile.down();
-    turnstile.up();
+SenseBarrier::SenseBarrier(int n) : count(0), phase() {
+    ASSERT(n > 0);
+    this->n = n;
+}
 
-    count_sync.down();
-    count = count - 1;
-    if (count == 0) {
-        turnstile.down(); // Lock the first turnstile
-        turnstile_sync.up();
-        count_sync.up();
+void SenseBarrier::sync() {
+    uint32_t my_phase = phase.current();
+    if (count.add_fetch(1, MemoryOrder::ACQ_REL) == n) {
+        // Reset before releasing anyone, the release store orders it before the phase change
+        count.set(0, MemoryOrder::RELAXED);
+        phase.advance(my_phase);
     } else {
-        count_sync.up();
+        phase.wait(my_phase);
+    }
+}
+
+TreeBarrier::TreeBarrier(int n) : phase() {
+    ASSERT(n > 0);
+    this->n = n;
+    for (uint32_t i = 0; i < LEAVES; i++) leaves[i].count.set(0, MemoryOrder::RELAXED);
+    for (uint32_t i = 0; i < INNER; i++) inner[i].count.set(0, MemoryOrder::RELAXED);
+    root.count.set(0, MemoryOrder::RELAXED);
+}
+
+// Adds arrivals to node, returns how many arrivals this thread must carry to the parent (0 if none)
+// The thread whose add finds the node empty is the carrier, it waits briefly so others can combine
+// with it and then takes everything that accumulated. Later arrivals find the node empty again
+uint32_t TreeBarrier::carry(Node* node, uint32_t arrivals) {
+    if (node->count.fetch_add(arrivals, MemoryOrder::ACQ_REL) != 0) {
+        return 0;
     }
+    for (uint32_t i = 0; i < COMBINE_SPIN; i++) {
+        __asm__ volatile("" ::: "memory");
+    }
+    return node->count.exchange(0, MemoryOrder::ACQ_REL);
+}
 
-    turnstile_sync.down();
-    turnstile_sync.up();
+void TreeBarrier::sync() {
+    uint32_t my_phase = phase.current();
+    uint32_t leaf = smp::me() % LEAVES; // Only for locality, correctness does not depend on the HART
+    uint32_t arrivals = carry(&leaves[leaf], 1);
+    if (arrivals == 0) {
+        phase.wait(my_phase);
+        return;
+    }
+    arrivals = carry(&inner[leaf / FANIN], arrivals);
+    if (arrivals == 0) {
+        phase.wait(my_phase);
+        return;
+    }
+    if (root.count.add_fetch(arrivals, MemoryOrder::ACQ_REL) == n) {
+        root.count.set(0, MemoryOrder::RELAXED);
+        phase.advance(my_phase);
+    } else {
+        phase.wait(my_phase);
+    }
 }
\ No newline at end of file
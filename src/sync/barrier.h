@@ -1,16 +1,72 @@
 #pragma once
 
 #include "atomic.h"
-#include "semaphore.h"
+#include "mutex.h"
+#include "condvar.h"
+#include "../boot/smp.h"
 
-// Implementation inspired from https://greenteapress.com/semaphores/LittleBookOfSemaphores.pdf
+// Reusable barrier, the generation count keeps a fast thread from slipping through the next phase early
 class Barrier {
     int n;
     int count;
-    Semaphore count_sync;
-    Semaphore turnstile;
-    Semaphore turnstile_sync;
+    uint32_t generation;
+    Mutex mutex;
+    CondVar all_arrived;
 public:
     Barrier(int n);
     void sync();
+};
+
+// Phase counter that barrier waiters spin on for a while and then park on
+// Threads have no thread-local sense flag, so the whole phase number acts as the sense
+class BarrierPhase {
+    static constexpr uint32_t SPIN_LIMIT = 1000;
+
+    alignas(CACHE_LINE_SIZE) Atomic<uint32_t> phase;
+    Atomic<uint32_t> sleepers; // Non-zero if a waiter may be parked on phase
+public:
+    BarrierPhase() : phase(0), sleepers(0) {}
+
+    uint32_t current() const {
+        return phase.get(MemoryOrder::ACQUIRE);
+    }
+
+    void wait(uint32_t my_phase);
+    void advance(uint32_t my_phase);
+};
+
+// Centralized sense-reversing barrier
+// Arrival is one atomic add, the last thread to arrive flips the phase and waiters spin then block
+class SenseBarrier {
+    uint32_t n;
+    alignas(CACHE_LINE_SIZE) Atomic<uint32_t> count;
+    BarrierPhase phase;
+public:
+    SenseBarrier(int n);
+    void sync();
+};
+
+// Software combining tree barrier for large thread counts
+// Threads arrive at their HART's leaf, the first arrival at a node carries everything that accumulated
+// there up to its parent, so the root sees a few large adds instead of one add per thread
+class TreeBarrier {
+    static constexpr uint32_t FANIN = 4;
+    static constexpr uint32_t LEAVES = smp::MAX_HARTS;
+    static constexpr uint32_t INNER = (LEAVES + FANIN - 1) / FANIN;
+    static constexpr uint32_t COMBINE_SPIN = 32;
+
+    struct alignas(CACHE_LINE_SIZE) Node {
+        Atomic<uint32_t> count;
+    };
+
+    uint32_t n;
+    Node leaves[LEAVES];
+    Node inner[INNER];
+    Node root;
+    BarrierPhase phase;
+
+    uint32_t carry(Node* node, uint32_t arrivals);
+public:
+    TreeBarrier(int n);
+    void sync();
 };
\ No newline at end of file
@@ -0,0 +1 @@
+#include "channel.h"
\ No newline at end of file
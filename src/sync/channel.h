@@ -0,0 +1,333 @@
+#pragma once
+
+#include "../common/common.h"
+#include "../common/utility.h"
+#include "../heap.h"
+#include "atomic.h"
+#include "spinlock.h"
+#include "sync_queue.h"
+#include "parking_lot.h"
+#include "../threads/threads.h"
+#include "../threads/scheduler.h"
+
+enum class ChannelStatus {
+    OK,
+    WOULD_BLOCK, // Full for a send, empty for a receive
+    CLOSED       // Closed, and for a receive also drained
+};
+
+template <typename T, uint32_t N>
+class Channel;
+
+template <typename T, uint32_t N>
+int32_t select(Channel<T, N>** channels, uint32_t count, T& out);
+
+// Bounded channel of up to N values of T between kthreads, in the style of Go channels
+// Values live in an in-place ring and are moved in and out, nothing is allocated per message
+// A sender that finds a blocked receiver moves the value straight into the receiver's destination,
+// and a receiver that frees a slot moves a blocked sender's value into it, so a woken thread never
+// has to retake the lock to finish its operation
+template <typename T, uint32_t N>
+class Channel {
+    static_assert(N >= 1, "Channel needs room for at least one value");
+
+    // What a blocked thread is waiting to do, pointed to by its TCB's wait_data
+    struct Waiter {
+        T* value; // Where a receiver wants its value, or what a sender wants to send
+        bool ok; // Set by the thread that completed the operation, false if the channel was closed
+    };
+
+    // A select() waiting on this channel, signaled whenever a value becomes available or on close
+    struct Watcher {
+        Atomic<uint32_t>* signaled;
+        Watcher* next;
+    };
+
+    Spinlock lock;
+    alignas(T) uint8_t storage[N * sizeof(T)];
+    uint32_t head; // Index of the oldest buffered value
+    uint32_t count; // Number of buffered values
+    bool closed;
+    IntrusiveQueue<threads::TCB> senders; // Blocked senders, only waiting while the ring is full
+    IntrusiveQueue<threads::TCB> receivers; // Blocked receivers, only waiting while the ring is empty
+    Watcher* watchers;
+
+    T* slot(uint32_t i) {
+        return (T*)&storage[((head + i) % N) * sizeof(T)];
+    }
+
+    // Caller holds lock
+    void push_locked(T&& value) {
+        new (slot(count)) T(util::move(value));
+        count++;
+    }
+
+    // Caller holds lock
+    void pop_locked(T& out) {
+        T* oldest = slot(0);
+        out = util::move(*oldest);
+        oldest->~T();
+        head = (head + 1) % N;
+        count--;
+    }
+
+    // Caller holds lock and just freed a slot, moves a blocked sender's value in and returns the sender
+    threads::TCB* refill_locked() {
+        threads::TCB* sender = senders.pop();
+        if (sender != nullptr) {
+            Waiter* waiter = (Waiter*)sender->wait_data;
+            push_locked(util::move(*waiter->value));
+            waiter->ok = true;
+        }
+        return sender;
+    }
+
+    // Caller holds lock, *woken is set to a receiver that must be scheduled once it is released
+    ChannelStatus send_locked(T& value, threads::TCB** woken) {
+        if (closed) {
+            return ChannelStatus::CLOSED;
+        }
+        threads::TCB* receiver = receivers.pop();
+        if (receiver != nullptr) {
+            Waiter* waiter = (Waiter*)receiver->wait_data;
+            *waiter->value = util::move(value);
+            waiter->ok = true;
+            *woken = receiver;
+            return ChannelStatus::OK;
+        }
+        if (count == N) {
+            return ChannelStatus::WOULD_BLOCK;
+        }
+        push_locked(util::move(value));
+        notify_watchers_locked();
+        return ChannelStatus::OK;
+    }
+
+    // Caller holds lock, *woken is set to a sender that must be scheduled once it is released
+    ChannelStatus recv_locked(T& out, threads::TCB** woken) {
+        if (count == 0) {
+            return closed ? ChannelStatus::CLOSED : ChannelStatus::WOULD_BLOCK;
+        }
+        pop_locked(out);
+        *woken = refill_locked();
+        return ChannelStatus::OK;
+    }
+
+    // Caller holds lock
+    void notify_watchers_locked() {
+        for (Watcher* watcher = watchers; watcher != nullptr; watcher = watcher->next) {
+            if (watcher->signaled->exchange(1, MemoryOrder::ACQ_REL) == 0) {
+                parking_lot::unpark_one(watcher->signaled);
+            }
+        }
+    }
+
+    static threads::TCB* disable_preemption(bool& old_preemption) {
+        bool was = pit::disable_interrupts();
+        threads::TCB* my_thread = threads::hartstates.mine().current_thread;
+        old_preemption = my_thread->setPreemption(false);
+        pit::restore_interrupts(was);
+        return my_thread;
+    }
+
+    static void restore_preemption(threads::TCB* my_thread, bool old_preemption) {
+        bool was = pit::disable_interrupts();
+        my_thread->setPreemption(old_preemption);
+        pit::restore_interrupts(was);
+    }
+
+    // Caller holds lock with preemption disabled, blocks on queue until another thread completes the
+    // operation described by waiter, returns whether it completed
+    static bool wait(threads::TCB* my_thread, IntrusiveQueue<threads::TCB>* queue, Spinlock* queue_lock, Waiter* waiter) {
+        my_thread->wait_data = waiter;
+        threads::wait_on(my_thread, queue, queue_lock);
+        my_thread->wait_data = nullptr;
+        return waiter->ok;
+    }
+
+    void add_watcher(Watcher* watcher, Atomic<uint32_t>* signaled) {
+        lock.lock();
+        watcher->signaled = signaled;
+        watcher->next = watchers;
+        watchers = watcher;
+        lock.unlock();
+    }
+
+    void remove_watcher(Watcher* watcher) {
+        lock.lock();
+        Watcher** link = &watchers;
+        while (*link != nullptr && *link != watcher) {
+            link = &(*link)->next;
+        }
+        if (*link != nullptr) {
+            *link = watcher->next;
+        }
+        lock.unlock();
+    }
+
+    friend int32_t select<T, N>(Channel<T, N>** channels, uint32_t count, T& out);
+
+public:
+    Channel() : lock(), head(0), count(0), closed(false), senders(), receivers(), watchers(nullptr) {}
+
+    ~Channel() {
+        while (count > 0) {
+            slot(0)->~T();
+            head = (head + 1) % N;
+            count--;
+        }
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    static constexpr uint32_t capacity() {
+        return N;
+    }
+
+    /**
+     * Sends value without blocking
+     * value is only moved from if the send succeeds
+     */
+    ChannelStatus try_send(T& value) {
+        lock.lock();
+        threads::TCB* woken = nullptr;
+        ChannelStatus status = send_locked(value, &woken);
+        lock.unlock();
+        if (woken != nullptr) {
+            scheduler::schedule(woken);
+        }
+        return status;
+    }
+
+    /**
+     * Receives into out without blocking
+     * Buffered values are still delivered after close, CLOSED means closed and drained
+     */
+    ChannelStatus try_recv(T& out) {
+        lock.lock();
+        threads::TCB* woken = nullptr;
+        ChannelStatus status = recv_locked(out, &woken);
+        lock.unlock();
+        if (woken != nullptr) {
+            scheduler::schedule(woken);
+        }
+        return status;
+    }
+
+    /**
+     * Sends value, blocking while the channel is full
+     * Returns false if the channel is or becomes closed before the value is taken
+     */
+    bool send(T value) {
+        bool old_preemption;
+        threads::TCB* my_thread = disable_preemption(old_preemption);
+        lock.lock();
+        threads::TCB* woken = nullptr;
+        ChannelStatus status = send_locked(value, &woken);
+        bool sent = status == ChannelStatus::OK;
+        if (status == ChannelStatus::WOULD_BLOCK) {
+            Waiter waiter = {&value, false};
+            sent = wait(my_thread, &senders, &lock, &waiter);
+        } else {
+            lock.unlock();
+            if (woken != nullptr) {
+                scheduler::schedule(woken);
+            }
+        }
+        restore_preemption(my_thread, old_preemption);
+        return sent;
+    }
+
+    /**
+     * Receives into out, blocking while the channel is empty
+     * Returns false once the channel is closed and drained
+     */
+    bool recv(T& out) {
+        bool old_preemption;
+        threads::TCB* my_thread = disable_preemption(old_preemption);
+        lock.lock();
+        threads::TCB* woken = nullptr;
+        ChannelStatus status = recv_locked(out, &woken);
+        bool received = status == ChannelStatus::OK;
+        if (status == ChannelStatus::WOULD_BLOCK) {
+            Waiter waiter = {&out, false};
+            received = wait(my_thread, &receivers, &lock, &waiter);
+        } else {
+            lock.unlock();
+            if (woken != nullptr) {
+                scheduler::schedule(woken);
+            }
+        }
+        restore_preemption(my_thread, old_preemption);
+        return received;
+    }
+
+    /**
+     * Closes the channel, blocked senders fail and blocked receivers get false
+     * Values already buffered can still be received
+     */
+    void close() {
+        IntrusiveQueue<threads::TCB> woken;
+        lock.lock();
+        closed = true;
+        for (threads::TCB* tcb = senders.pop(); tcb != nullptr; tcb = senders.pop()) {
+            woken.push(tcb); // Their waiters keep ok = false
+        }
+        for (threads::TCB* tcb = receivers.pop(); tcb != nullptr; tcb = receivers.pop()) {
+            woken.push(tcb);
+        }
+        notify_watchers_locked();
+        lock.unlock();
+        scheduler::schedule_all(&woken);
+    }
+};
+
+constexpr uint32_t MAX_SELECT = 16;
+
+/**
+ * Receives from whichever of channels has a value first, blocking until one does
+ * Returns the index of the channel out came from, or -1 once every channel is closed and drained
+ * Earlier channels win when several are ready
+ */
+template <typename T, uint32_t N>
+int32_t select(Channel<T, N>** channels, uint32_t count, T& out) {
+    ASSERT(count > 0 && count <= MAX_SELECT);
+    typename Channel<T, N>::Watcher watchers[MAX_SELECT];
+    Atomic<uint32_t> signaled(0);
+    bool watching = false;
+    int32_t result;
+    while (true) {
+        uint32_t drained = 0;
+        result = -1;
+        for (uint32_t i = 0; i < count && result < 0; i++) {
+            ChannelStatus status = channels[i]->try_recv(out);
+            if (status == ChannelStatus::OK) {
+                result = i;
+            } else if (status == ChannelStatus::CLOSED) {
+                drained++;
+            }
+        }
+        if (result >= 0 || drained == count) {
+            break;
+        }
+        if (!watching) {
+            // Poll once more after registering, a value sent before we were watching would be missed
+            for (uint32_t i = 0; i < count; i++) {
+                channels[i]->add_watcher(&watchers[i], &signaled);
+            }
+            watching = true;
+            continue;
+        }
+        parking_lot::park(&signaled, [&signaled] {
+            return signaled.get(MemoryOrder::ACQUIRE) == 0;
+        });
+        signaled.set(0, MemoryOrder::RELAXED);
+    }
+    if (watching) {
+        for (uint32_t i = 0; i < count; i++) {
+            channels[i]->remove_watcher(&watchers[i]);
+        }
+    }
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1 @@
+#include "concurrent_map.h"
\ No newline at end of file
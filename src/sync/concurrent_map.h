@@ -0,0 +1,239 @@
+#pragma once
+
+#include "../common/common.h"
+#include "../common/hash.h"
+#include "../common/utility.h"
+#include "atomic.h"
+#include "spinlock.h"
+
+// Hash map with lock striping, for maps shared between threads and interrupt handlers
+// Buckets are chained, bucket i is protected by stripe i % NUM_STRIPES. Both are masked from the
+// same hash, so a key keeps its stripe when the table doubles
+// Stripes are spinlocks, so operations never sleep and can be used from the virtio ISR
+// Resizing takes every stripe in order and rehashes in place of the old table
+template <typename K, typename V>
+class ConcurrentMap {
+    static constexpr uint32_t NUM_STRIPES = 16;
+    static constexpr uint32_t MAX_LOAD = 2; // Average chain length that triggers a resize
+
+    struct Node {
+        K key;
+        V value;
+        Node* next;
+        Node(const K& key, const V& value, Node* next) : key(key), value(value), next(next) {}
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Stripe {
+        Spinlock lock;
+    };
+
+    Stripe stripes[NUM_STRIPES];
+    Node** buckets; // Only replaced with every stripe held
+    uint32_t num_buckets; // Power of two, at least NUM_STRIPES
+    alignas(CACHE_LINE_SIZE) Atomic<uint32_t> count;
+
+    Spinlock& stripe_for(uint32_t hash) {
+        return stripes[hash & (NUM_STRIPES - 1)].lock;
+    }
+
+    // Caller holds the key's stripe
+    Node** slot_for(const K& key, uint32_t hash) {
+        Node** slot = &buckets[hash & (num_buckets - 1)];
+        while (*slot != nullptr && !((*slot)->key == key)) {
+            slot = &(*slot)->next;
+        }
+        return slot;
+    }
+
+    void lock_all() {
+        for (uint32_t i = 0; i < NUM_STRIPES; i++) {
+            stripes[i].lock.lock();
+        }
+    }
+
+    void unlock_all() {
+        for (uint32_t i = NUM_STRIPES; i > 0; i--) {
+            stripes[i - 1].lock.unlock();
+        }
+    }
+
+    // Doubles the table if it is still overloaded once every stripe is held
+    void grow() {
+        lock_all();
+        if (count.get(MemoryOrder::RELAXED) <= num_buckets * MAX_LOAD) {
+            unlock_all();
+            return; // Another thread already grew it
+        }
+        uint32_t new_size = num_buckets * 2;
+        Node** new_buckets = new Node*[new_size]();
+        for (uint32_t i = 0; i < num_buckets; i++) {
+            Node* node = buckets[i];
+            while (node != nullptr) {
+                Node* next = node->next;
+                uint32_t index = hashing::hash_of(node->key) & (new_size - 1);
+                node->next = new_buckets[index];
+                new_buckets[index] = node;
+                node = next;
+            }
+        }
+        Node** old_buckets = buckets;
+        buckets = new_buckets;
+        num_buckets = new_size;
+        unlock_all();
+        delete[] old_buckets;
+    }
+
+public:
+    ConcurrentMap(uint32_t min_buckets = NUM_STRIPES) : stripes(), count(0) {
+        num_buckets = NUM_STRIPES;
+        while (num_buckets < min_buckets) {
+            num_buckets *= 2;
+        }
+        buckets = new Node*[num_buckets]();
+    }
+
+    ~ConcurrentMap() {
+        clear();
+        delete[] buckets;
+    }
+
+    ConcurrentMap(const ConcurrentMap&) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap&) = delete;
+
+    uint32_t size() const {
+        return count.get(MemoryOrder::RELAXED);
+    }
+
+    /**
+     * Inserts key, or replaces its value if it is already present
+     * Returns true if the key was inserted
+     */
+    bool put(const K& key, const V& value) {
+        uint32_t hash = hashing::hash_of(key);
+        Spinlock& lock = stripe_for(hash);
+        lock.lock();
+        Node** slot = slot_for(key, hash);
+        if (*slot != nullptr) {
+            V old = util::move((*slot)->value);
+            (*slot)->value = value;
+            lock.unlock();
+            (void)old; // Destroyed here, outside the lock
+            return false;
+        }
+        *slot = new Node(key, value, nullptr);
+        uint32_t size = count.add_fetch(1, MemoryOrder::RELAXED);
+        bool overloaded = size > num_buckets * MAX_LOAD;
+        lock.unlock();
+        if (overloaded) {
+            grow();
+        }
+        return true;
+    }
+
+    /**
+     * Copies the value for key into value, returns false if the key is not present
+     */
+    bool find(const K& key, V& value) {
+        uint32_t hash = hashing::hash_of(key);
+        Spinlock& lock = stripe_for(hash);
+        lock.lock();
+        Node* node = *slot_for(key, hash);
+        bool found = node != nullptr;
+        if (found) {
+            value = node->value;
+        }
+        lock.unlock();
+        return found;
+    }
+
+    /**
+     * Returns the value for key, panics if it is not present
+     */
+    V get(const K& key) {
+        V value;
+        if (!find(key, value)) {
+            PANIC("No element found in map that matches the provided key\n");
+        }
+        return value;
+    }
+
+    bool contains(const K& key) {
+        uint32_t hash = hashing::hash_of(key);
+        Spinlock& lock = stripe_for(hash);
+        lock.lock();
+        bool found = *slot_for(key, hash) != nullptr;
+        lock.unlock();
+        return found;
+    }
+
+    /**
+     * Removes key and moves its value into value, returns false if the key is not present
+     */
+    bool take(const K& key, V& value) {
+        uint32_t hash = hashing::hash_of(key);
+        Spinlock& lock = stripe_for(hash);
+        lock.lock();
+        Node** slot = slot_for(key, hash);
+        Node* node = *slot;
+        if (node == nullptr) {
+            lock.unlock();
+            return false;
+        }
+        *slot = node->next;
+        count.fetch_add(-1, MemoryOrder::RELAXED);
+        lock.unlock();
+        value = util::move(node->value);
+        delete node;
+        return true;
+    }
+
+    bool remove(const K& key) {
+        V value;
+        return take(key, value);
+    }
+
+    /**
+     * Calls f(key, value) for every entry
+     * One stripe is held at a time, so entries added or removed concurrently may or may not be seen
+     * f runs under a spinlock and must not block or touch this map
+     */
+    template <typename F>
+    void for_each(F f) {
+        for (uint32_t s = 0; s < NUM_STRIPES; s++) {
+            stripes[s].lock.lock();
+            for (uint32_t i = s; i < num_buckets; i += NUM_STRIPES) {
+                for (Node* node = buckets[i]; node != nullptr; node = node->next) {
+                    f((const K&)node->key, node->value);
+                }
+            }
+            stripes[s].lock.unlock();
+        }
+    }
+
+    /**
+     * Removes every entry
+     */
+    void clear() {
+        for (uint32_t s = 0; s < NUM_STRIPES; s++) {
+            Node* removed = nullptr;
+            stripes[s].lock.lock();
+            for (uint32_t i = s; i < num_buckets; i += NUM_STRIPES) {
+                Node* node = buckets[i];
+                buckets[i] = nullptr;
+                while (node != nullptr) {
+                    Node* next = node->next;
+                    node->next = removed;
+                    removed = node;
+                    count.fetch_add(-1, MemoryOrder::RELAXED);
+                    node = next;
+                }
+            }
+            stripes[s].lock.unlock();
+            while (removed != nullptr) {
+                Node* next = removed->next;
+                delete removed;
+                removed = next;
+            }
+        }
+    }
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "condvar.h"
+
+CondVar::CondVar() : lock(), waiters(), mutex(nullptr) {}
+
+// Atomically releases mutex and blocks until notified, returns holding mutex again
+void CondVar::wait(Mutex& mutex) {
+    bool was = pit::disable_interrupts();
+    threads::TCB* my_thread = threads::hartstates.mine().current_thread;
+    my_thread->setPreemption(false);
+    pit::restore_interrupts(was);
+
+    lock.lock();
+    ASSERT(this->mutex == nullptr || this->mutex == &mutex);
+    this->mutex = &mutex;
+    mutex.unlock();
+    my_thread->setPreemption(false); // unlock() re-enables preemption, but we are about to block
+    // A notifier hands us the mutex before scheduling us, so we own it when wait_on returns
+    threads::wait_on(my_thread, &waiters, &lock);
+#ifdef CONFIG_LOCKSTAT
+    // requeue_all handed us the mutex without a down(), so its hold starts here
+    // Time spent waiting on the condition is not lock contention, so no wait is recorded
+    mutex.sem.stats.acquired(pit::get_time(), false);
+#endif
+
+    was = pit::disable_interrupts();
+    if (my_thread != threads::hartstates.mine().idle_thread) {
+        my_thread->setPreemption(true);
+    }
+    pit::restore_interrupts(was);
+}
+
+// Moves one waiter onto the mutex
+void CondVar::notify_one() {
+    lock.lock();
+    threads::TCB* waiter = waiters.pop();
+    Mutex* target = mutex;
+    if (waiters.empty()) {
+        mutex = nullptr;
+    }
+    lock.unlock();
+    if (waiter != nullptr) {
+        IntrusiveQueue<threads::TCB> woken;
+        woken.push(waiter);
+        target->sem.requeue_all(&woken);
+    }
+}
+
+// Moves every waiter onto the mutex with a single acquisition of the mutex's lock
+void CondVar::notify_all() {
+    lock.lock();
+    IntrusiveQueue<threads::TCB> woken = waiters;
+    waiters = IntrusiveQueue<threads::TCB>();
+    Mutex* target = mutex;
+    mutex = nullptr;
+    lock.unlock();
+    if (!woken.empty()) {
+        target->sem.requeue_all(&woken);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "spinlock.h"
+#include "mutex.h"
+#include "sync_queue.h"
+#include "../threads/threads.h"
+
+// Condition variable used together with a Mutex
+// Notified waiters are moved straight onto the mutex's wait queue (wait morphing), so they wake
+// one at a time as the mutex is handed over instead of all waking up to fight for it
+class CondVar {
+    Spinlock lock;
+    IntrusiveQueue<threads::TCB> waiters; // Protected by lock
+    Mutex* mutex; // The mutex current waiters hold, all waiters must use the same one
+public:
+    CondVar();
+    void wait(Mutex& mutex);
+    void notify_one();
+    void notify_all();
+};
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include "latch.h"
+#include "parking_lot.h"
+
+void Latch::wait_slow() {
+    while (true) {
+        uint32_t s = state.get(MemoryOrder::ACQUIRE);
+        if ((s & COUNT_MASK) == 0) {
+            return;
+        }
+        if ((s & WAITERS) == 0) {
+            if (!state.compare_and_swap(s, s | WAITERS)) {
+                continue;
+            }
+            s = s | WAITERS;
+        }
+        // Only sleep if nothing changed since we announced ourselves
+        parking_lot::park(&state, [this, s] {
+            return state.get(MemoryOrder::RELAXED) == s;
+        });
+    }
+}
+
+void Latch::wake_all() {
+    parking_lot::unpark_all(&state);
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../common/common.h"
+#include "atomic.h"
+
+// Single-use countdown latch on one word, waiters park in the parking lot keyed by the state word
+// Threads that count down never block, only wait() does, and only while the count is non-zero
+// The top bit records that threads may be parked, so the last count_down only touches the parking
+// lot when someone is waiting, and then wakes every waiter in one batch
+class Latch {
+    static constexpr uint32_t WAITERS = 0x80000000;
+    static constexpr uint32_t COUNT_MASK = ~WAITERS;
+
+    Atomic<uint32_t> state;
+    void wait_slow();
+    void wake_all();
+public:
+    Latch(uint32_t count) : state(count) {}
+
+    // Decrement the count by n, waking all waiters if it reaches 0
+    void count_down(uint32_t n = 1) {
+        uint32_t s = state.fetch_add(-n, MemoryOrder::RELEASE);
+        ASSERT((s & COUNT_MASK) >= n);
+        if ((s & COUNT_MASK) == n && (s & WAITERS)) {
+            wake_all();
+        }
+    }
+
+    // Whether the count has reached 0
+    bool try_wait() const {
+        return (state.get(MemoryOrder::ACQUIRE) & COUNT_MASK) == 0;
+    }
+
+    // Block until the count reaches 0
+    void wait() {
+        if (!try_wait()) {
+            wait_slow();
+        }
+    }
+
+    void arrive_and_wait(uint32_t n = 1) {
+        count_down(n);
+        wait();
+    }
+};
+
+static_assert(sizeof(Latch) == 4, "Latch must stay one word");
\ No newline at end of file
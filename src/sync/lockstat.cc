@@ -0,0 +1,183 @@
+#include "lockstat.h"
+
+#ifdef CONFIG_LOCKSTAT
+#include "../boot/pit.h"
+
+// LockStats gives every lock a destructor, so global locks now register one at startup
+// Global constructors never run and the kernel never exits, these only satisfy the linker
+extern "C" int __cxa_atexit(void (*)(void*), void*, void*) {
+    return 0;
+}
+void* __dso_handle;
+
+namespace lockstat {
+
+    // Registry of every lock that has been acquired
+    // Guarded by a bare test-and-set word, an instrumented lock here would recurse into itself
+    Atomic<uint32_t> registryLock;
+    LockStats* registry;
+
+    static bool lock_registry() {
+        bool was = pit::disable_interrupts();
+        while (registryLock.exchange(1, MemoryOrder::ACQUIRE) != 0) {
+            while (registryLock.get(MemoryOrder::RELAXED) != 0) {}
+        }
+        return was;
+    }
+
+    static void unlock_registry(bool was) {
+        registryLock.set(0, MemoryOrder::RELEASE);
+        pit::restore_interrupts(was);
+    }
+
+    static void register_stats(LockStats* stats) {
+        if (!stats->registered.compare_and_swap(0, 1, MemoryOrder::RELAXED)) {
+            return;
+        }
+        bool was = lock_registry();
+        stats->next = registry;
+        registry = stats;
+        unlock_registry(was);
+    }
+
+    static void max_into(Atomic<uint32_t>& max, uint32_t value) {
+        uint32_t old = max.get(MemoryOrder::RELAXED);
+        while (value > old && !max.compare_and_swap(old, value, MemoryOrder::RELAXED)) {
+            old = max.get(MemoryOrder::RELAXED);
+        }
+    }
+
+    static uint32_t bucket_of(uint64_t ticks) {
+        uint32_t bucket = 0;
+        ticks++;
+        while (ticks > 1 && bucket < HOLD_BUCKETS - 1) {
+            ticks >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    LockStats::LockStats(const char* name) : name(name), acquisitions(0), contended(0), wait_total(0), wait_max(0),
+        hold_total(0), hold_max(0), hold_histogram(), acquired_at(0), registered(0), next(nullptr) {}
+
+    LockStats::LockStats(const LockStats& other) : LockStats(other.name) {}
+
+    LockStats& LockStats::operator=(const LockStats& other) {
+        name = other.name;
+        return *this;
+    }
+
+    LockStats::~LockStats() {
+        if (registered.get(MemoryOrder::RELAXED)) {
+            bool was = lock_registry();
+            LockStats** link = &registry;
+            while (*link != nullptr && *link != this) {
+                link = &(*link)->next;
+            }
+            if (*link != nullptr) {
+                *link = next;
+            }
+            unlock_registry(was);
+        }
+    }
+
+    void LockStats::acquired(uint64_t wait_start, bool was_contended) {
+        uint64_t now = pit::get_time();
+        if (!registered.get(MemoryOrder::RELAXED)) {
+            register_stats(this);
+        }
+        acquisitions.fetch_add(1, MemoryOrder::RELAXED);
+        if (was_contended) {
+            uint64_t waited = now - wait_start;
+            contended.fetch_add(1, MemoryOrder::RELAXED);
+            wait_total.fetch_add(waited, MemoryOrder::RELAXED);
+            max_into(wait_max, (uint32_t)waited);
+        }
+        acquired_at = now;
+    }
+
+    void LockStats::released() {
+        if (acquired_at == 0) {
+            return; // A semaphore up() without a matching down()
+        }
+        uint64_t held = pit::get_time() - acquired_at;
+        acquired_at = 0;
+        hold_total.fetch_add(held, MemoryOrder::RELAXED);
+        max_into(hold_max, (uint32_t)held);
+        hold_histogram[bucket_of(held)].fetch_add(1, MemoryOrder::RELAXED);
+    }
+
+    constexpr uint32_t DUMP_LOCKS = 32;
+
+    struct Snapshot {
+        const void* lock;
+        const char* name;
+        uint32_t acquisitions;
+        uint32_t contended;
+        uint64_t wait_total;
+        uint32_t wait_max;
+        uint64_t hold_total;
+        uint32_t hold_max;
+        uint32_t hold_histogram[HOLD_BUCKETS];
+    };
+
+    /**
+     * Prints the DUMP_LOCKS most contended locks
+     * Counters are copied under the registry lock and printed after, printf takes printLock itself
+     */
+    void dump() {
+        Snapshot* top = new Snapshot[DUMP_LOCKS];
+        uint32_t count = 0;
+        uint32_t total = 0;
+        bool was = lock_registry();
+        for (LockStats* stats = registry; stats != nullptr; stats = stats->next) {
+            total++;
+            uint32_t contended = stats->contended.get(MemoryOrder::RELAXED);
+            // Insertion into top, ordered by contended acquisitions
+            uint32_t pos = count < DUMP_LOCKS ? count : DUMP_LOCKS;
+            while (pos > 0 && top[pos - 1].contended < contended) {
+                pos--;
+            }
+            if (pos == DUMP_LOCKS) {
+                continue;
+            }
+            uint32_t last = count < DUMP_LOCKS ? count : DUMP_LOCKS - 1;
+            for (uint32_t i = last; i > pos; i--) {
+                top[i] = top[i - 1];
+            }
+            if (count < DUMP_LOCKS) {
+                count++;
+            }
+            Snapshot& snap = top[pos];
+            snap.lock = stats;
+            snap.name = stats->name != nullptr ? stats->name : "unnamed";
+            snap.acquisitions = stats->acquisitions.get(MemoryOrder::RELAXED);
+            snap.contended = contended;
+            snap.wait_total = stats->wait_total.get(MemoryOrder::RELAXED);
+            snap.wait_max = stats->wait_max.get(MemoryOrder::RELAXED);
+            snap.hold_total = stats->hold_total.get(MemoryOrder::RELAXED);
+            snap.hold_max = stats->hold_max.get(MemoryOrder::RELAXED);
+            for (uint32_t b = 0; b < HOLD_BUCKETS; b++) {
+                snap.hold_histogram[b] = stats->hold_histogram[b].get(MemoryOrder::RELAXED);
+            }
+        }
+        unlock_registry(was);
+
+        printf("lockstat: %d locks registered, top %d by contention (times in ticks)\n", total, count);
+        for (uint32_t i = 0; i < count; i++) {
+            Snapshot& snap = top[i];
+            printf("lockstat: %s (%x): acq %d, contended %d, wait total %d max %d, hold total %d max %d\n",
+                   snap.name, snap.lock, snap.acquisitions, snap.contended,
+                   (uint32_t)snap.wait_total, snap.wait_max, (uint32_t)snap.hold_total, snap.hold_max);
+            printf("lockstat:   hold histogram (log2 ticks):");
+            for (uint32_t b = 0; b < HOLD_BUCKETS; b++) {
+                if (snap.hold_histogram[b] != 0) {
+                    printf(" [%d]=%d", b, snap.hold_histogram[b]);
+                }
+            }
+            printf("\n");
+        }
+        delete[] top;
+    }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../common/common.h"
+#include "atomic.h"
+
+// Lock contention statistics, compiled in with -DCONFIG_LOCKSTAT (LOCKSTAT=1 ./run.sh)
+// Spinlock, SpinlockNoInterrupts and Semaphore embed a LockStats when it is on, and nothing otherwise
+// Times are in timer ticks read from the time CSR
+// A lock joins the registry on its first acquisition and leaves it when destroyed, dump() prints
+// the most contended registered locks
+#ifdef CONFIG_LOCKSTAT
+namespace lockstat {
+
+    constexpr uint32_t HOLD_BUCKETS = 16; // Bucket i counts hold times in [2^i - 1, 2^(i+1) - 1) ticks
+
+    class LockStats {
+    public:
+        const char* name;
+        Atomic<uint32_t> acquisitions;
+        Atomic<uint32_t> contended; // Acquisitions that had to spin or block
+        Atomic<uint64_t> wait_total;
+        Atomic<uint32_t> wait_max;
+        Atomic<uint64_t> hold_total;
+        Atomic<uint32_t> hold_max;
+        Atomic<uint32_t> hold_histogram[HOLD_BUCKETS];
+        uint64_t acquired_at; // Only written by the holder
+        Atomic<uint32_t> registered;
+        LockStats* next; // Registry link, protected by the registry lock
+
+        LockStats(const char* name = nullptr);
+        // Copies only carry the name, a copy is a different lock
+        LockStats(const LockStats& other);
+        LockStats& operator=(const LockStats& other);
+        ~LockStats();
+
+        // Called once the lock is held, wait_start is when the caller started trying
+        void acquired(uint64_t wait_start, bool was_contended);
+        // Called just before the lock is released
+        void released();
+    };
+
+    extern void dump();
+};
+#endif
\ No newline at end of file
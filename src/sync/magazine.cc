@@ -0,0 +1 @@
+#include "magazine.h"
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "../common/common.h"
+#include "../boot/smp.h"
+#include "../boot/pit.h"
+#include "spinlock.h"
+
+// Per-HART object caching with magazines, after Bonwick and Adams' "Magazines and Vmem" (2001)
+// Each HART holds a loaded and a previous magazine of up to MAGAZINE_SIZE free objects. Allocation and
+// free only touch these with interrupts off, under a per-HART lock that is only contended when another
+// HART steals from them
+// Whole magazines move to and from a global depot under a spinlock when both are exhausted or full
+// When the depot is empty too, try_allocate takes an object out of another HART's magazines, so it only
+// fails when no object is free anywhere
+// An all-zero MagazineCache is valid, magazines are allocated on first use
+template <typename T, uint32_t MAGAZINE_SIZE = 16>
+class MagazineCache {
+    struct Magazine {
+        uint32_t rounds;
+        Magazine* next;
+        T* objects[MAGAZINE_SIZE];
+    };
+
+    struct HartCache {
+        SpinlockNoInterrupts lock;
+        Magazine* loaded;
+        Magazine* previous;
+    };
+
+    smp::PerCPU<HartCache> harts;
+    Spinlock depotLock;
+    Magazine* full; // Depot magazines holding at least one object, protected by depotLock
+    Magazine* empty; // Depot magazines holding none, protected by depotLock
+
+    static void swap(HartCache& cache) {
+        Magazine* tmp = cache.loaded;
+        cache.loaded = cache.previous;
+        cache.previous = tmp;
+    }
+
+    static Magazine* pop_list(Magazine** list) {
+        Magazine* mag = *list;
+        if (mag != nullptr) {
+            *list = mag->next;
+        }
+        return mag;
+    }
+
+    static void push_list(Magazine** list, Magazine* mag) {
+        mag->next = *list;
+        *list = mag;
+    }
+
+    // Interrupts must be off, returns with the cache's lock held
+    HartCache& mine() {
+        HartCache& cache = harts.mine();
+        cache.lock.lock();
+        if (cache.loaded == nullptr) {
+            cache.loaded = new Magazine();
+            cache.previous = new Magazine();
+        }
+        return cache;
+    }
+
+    // Interrupts must be off and no HartCache lock held, takes one object from any HART's magazines
+    // Objects freed on a HART that stopped using the cache would otherwise never come back
+    T* steal() {
+        for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
+            HartCache& cache = harts.forCPU(id);
+            T* obj = nullptr;
+            cache.lock.lock();
+            if (cache.loaded != nullptr) {
+                if (cache.loaded->rounds > 0) {
+                    obj = cache.loaded->objects[--cache.loaded->rounds];
+                } else if (cache.previous->rounds > 0) {
+                    obj = cache.previous->objects[--cache.previous->rounds];
+                }
+            }
+            cache.lock.unlock();
+            if (obj != nullptr) {
+                return obj;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    /**
+     * Returns a cached object, or nullptr if neither the depot nor any HART has one
+     */
+    T* try_allocate() {
+        bool was = pit::disable_interrupts();
+        HartCache& cache = mine();
+        if (cache.loaded->rounds == 0) {
+            if (cache.previous->rounds > 0) {
+                swap(cache);
+            } else {
+                // Both are empty: trade the previous one for a full magazine from the depot
+                depotLock.lock();
+                Magazine* refill = pop_list(&full);
+                if (refill != nullptr) {
+                    push_list(&empty, cache.previous);
+                    cache.previous = cache.loaded;
+                    cache.loaded = refill;
+                }
+                depotLock.unlock();
+                if (refill == nullptr) {
+                    cache.lock.unlock();
+                    T* obj = steal();
+                    pit::restore_interrupts(was);
+                    return obj;
+                }
+            }
+        }
+        T* obj = cache.loaded->objects[--cache.loaded->rounds];
+        cache.lock.unlock();
+        pit::restore_interrupts(was);
+        return obj;
+    }
+
+    /**
+     * Caches obj for a later try_allocate
+     */
+    void free(T* obj) {
+        bool was = pit::disable_interrupts();
+        HartCache& cache = mine();
+        if (cache.loaded->rounds == MAGAZINE_SIZE) {
+            if (cache.previous->rounds < MAGAZINE_SIZE) {
+                swap(cache);
+            } else {
+                // Both are full: hand the previous one to the depot for an empty magazine
+                depotLock.lock();
+                push_list(&full, cache.previous);
+                Magazine* spare = pop_list(&empty);
+                depotLock.unlock();
+                if (spare == nullptr) {
+                    spare = new Magazine();
+                }
+                cache.previous = cache.loaded;
+                cache.loaded = spare;
+            }
+        }
+        cache.loaded->objects[cache.loaded->rounds++] = obj;
+        cache.lock.unlock();
+        pit::restore_interrupts(was);
+    }
+
+    /**
+     * Moves this HART's cached objects to the depot so other HARTs can allocate them
+     */
+    void flush() {
+        bool was = pit::disable_interrupts();
+        HartCache& cache = mine();
+        Magazine* spare_loaded = nullptr;
+        Magazine* spare_previous = nullptr;
+        depotLock.lock();
+        if (cache.loaded->rounds > 0) {
+            push_list(&full, cache.loaded);
+            spare_loaded = pop_list(&empty);
+            cache.loaded = nullptr;
+        }
+        if (cache.previous->rounds > 0) {
+            push_list(&full, cache.previous);
+            spare_previous = pop_list(&empty);
+            cache.previous = nullptr;
+        }
+        depotLock.unlock();
+        if (cache.loaded == nullptr) {
+            cache.loaded = spare_loaded != nullptr ? spare_loaded : new Magazine();
+        }
+        if (cache.previous == nullptr) {
+            cache.previous = spare_previous != nullptr ? spare_previous : new Magazine();
+        }
+        cache.lock.unlock();
+        pit::restore_interrupts(was);
+    }
+};
\ No newline at end of file
@@ -0,0 +1 @@
+#include "mpmc_queue.h"
\ No newline at end of file
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "../common/common.h"
+#include "../threads/threads.h"
+#include "atomic.h"
+
+// Bounded lock-free multi-producer multi-consumer ring, based on Dmitry Vyukov's bounded MPMC queue
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// Each slot carries a sequence number that tells producers and consumers whose turn it is
+// N must be a power of two. Never allocates, so T is stored by value
+//
+// Sequence loads are acquires and publishes are releases, so the slot data needs no other fences
+// Slot i stores its sequence number minus i, so an all-zero ring is a valid empty ring
+// and MPMCQueue globals work without running a constructor
+template <typename T, uint32_t N>
+class MPMCQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MPMCQueue size must be a power of two");
+    static constexpr uint32_t MASK = N - 1;
+
+    struct Cell {
+        Atomic<uint32_t> sequence; // Slot sequence number minus the slot index
+        T data;
+    };
+
+    alignas(CACHE_LINE_SIZE) Atomic<uint32_t> enqueue_pos;
+    alignas(CACHE_LINE_SIZE) Atomic<uint32_t> dequeue_pos;
+    alignas(CACHE_LINE_SIZE) Cell cells[N];
+
+    uint32_t sequence_of(uint32_t index) const {
+        return cells[index].sequence.get(MemoryOrder::ACQUIRE) + index;
+    }
+
+    void publish(uint32_t index, uint32_t sequence) {
+        cells[index].sequence.set(sequence - index, MemoryOrder::RELEASE);
+    }
+
+public:
+    MPMCQueue() : enqueue_pos(0), dequeue_pos(0) {
+        for (uint32_t i = 0; i < N; i++) {
+            cells[i].sequence.set(0, MemoryOrder::RELAXED);
+        }
+    }
+
+    static constexpr uint32_t capacity() {
+        return N;
+    }
+
+    /**
+     * Pushes val, returns false if the ring is full
+     */
+    bool try_push(const T& val) {
+        uint32_t pos;
+        while (true) {
+            pos = enqueue_pos.get(MemoryOrder::RELAXED);
+            int32_t diff = (int32_t)(sequence_of(pos & MASK) - pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_and_swap(pos, pos + 1, MemoryOrder::RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full: the consumer has not freed this slot yet
+            }
+            // Otherwise another producer claimed pos, reload
+        }
+        cells[pos & MASK].data = val;
+        publish(pos & MASK, pos + 1);
+        return true;
+    }
+
+    /**
+     * Pops into val, returns false if the ring is empty
+     */
+    bool try_pop(T& val) {
+        uint32_t pos;
+        while (true) {
+            pos = dequeue_pos.get(MemoryOrder::RELAXED);
+            int32_t diff = (int32_t)(sequence_of(pos & MASK) - (pos + 1));
+            if (diff == 0) {
+                if (dequeue_pos.compare_and_swap(pos, pos + 1, MemoryOrder::RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Empty: no producer has filled this slot yet
+            }
+        }
+        val = cells[pos & MASK].data;
+        publish(pos & MASK, pos + N);
+        return true;
+    }
+
+    /**
+     * Pushes up to count items with a single claim of consecutive slots
+     * Returns the number of items pushed, 0 if the ring is full
+     */
+    uint32_t push_n(const T* items, uint32_t count) {
+        uint32_t pos;
+        uint32_t n;
+        while (true) {
+            pos = enqueue_pos.get(MemoryOrder::RELAXED);
+            int32_t diff = 0;
+            for (n = 0; n < count && n < N; n++) {
+                diff = (int32_t)(sequence_of((pos + n) & MASK) - (pos + n));
+                if (diff != 0) {
+                    break;
+                }
+            }
+            if (n == 0) {
+                if (count == 0 || diff < 0) {
+                    return 0;
+                }
+                continue;
+            }
+            if (enqueue_pos.compare_and_swap(pos, pos + n, MemoryOrder::RELAXED)) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            cells[(pos + i) & MASK].data = items[i];
+            publish((pos + i) & MASK, pos + i + 1);
+        }
+        return n;
+    }
+
+    /**
+     * Pops up to count items with a single claim of consecutive slots
+     * Returns the number of items popped, 0 if the ring is empty
+     */
+    uint32_t pop_n(T* items, uint32_t count) {
+        uint32_t pos;
+        uint32_t n;
+        while (true) {
+            pos = dequeue_pos.get(MemoryOrder::RELAXED);
+            int32_t diff = 0;
+            for (n = 0; n < count && n < N; n++) {
+                diff = (int32_t)(sequence_of((pos + n) & MASK) - (pos + n + 1));
+                if (diff != 0) {
+                    break;
+                }
+            }
+            if (n == 0) {
+                if (count == 0 || diff < 0) {
+                    return 0;
+                }
+                continue;
+            }
+            if (dequeue_pos.compare_and_swap(pos, pos + n, MemoryOrder::RELAXED)) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            items[i] = cells[(pos + i) & MASK].data;
+            publish((pos + i) & MASK, pos + i + N);
+        }
+        return n;
+    }
+};
+
+// MPMCQueue whose push and pop wait for room or data
+// The fast path is the lock-free ring, waiting threads yield to other kthreads between attempts
+// so this must not be used from the idle thread or an interrupt handler when it could wait
+template <typename T, uint32_t N>
+class BlockingMPMCQueue {
+    MPMCQueue<T, N> ring;
+public:
+    BlockingMPMCQueue() : ring() {}
+
+    bool try_push(const T& val) {
+        return ring.try_push(val);
+    }
+
+    bool try_pop(T& val) {
+        return ring.try_pop(val);
+    }
+
+    uint32_t push_n(const T* items, uint32_t count) {
+        return ring.push_n(items, count);
+    }
+
+    uint32_t pop_n(T* items, uint32_t count) {
+        return ring.pop_n(items, count);
+    }
+
+    void push(const T& val) {
+        while (!ring.try_push(val)) {
+            threads::yield();
+        }
+    }
+
+    T pop() {
+        T val;
+        while (!ring.try_pop(val)) {
+            threads::yield();
+        }
+        return val;
+    }
+};
@@ -7,5 +7,8 @@ void Mutex::lock() {
 }
 
 void Mutex::unlock() {
+#ifdef CONFIG_LOCKSTAT
+    sem.stats.released(); // Hold times only mean something for a binary semaphore
+#endif
     sem.up();
 }
\ No newline at end of file
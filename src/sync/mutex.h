@@ -2,10 +2,18 @@
 
 #include "semaphore.h"
 
+class CondVar;
+
 class Mutex {
     Semaphore sem;
 public:
     Mutex();
     void lock();
     void unlock();
+
+    void set_name(const char* name) {
+        sem.set_name(name);
+    }
+
+    friend class CondVar; // Requeues waiters directly onto sem
 };
\ No newline at end of file
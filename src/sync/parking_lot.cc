@@ -0,0 +1,34 @@
+#include "parking_lot.h"
+
+namespace parking_lot {
+
+    constexpr uint32_t BUCKET_BITS = 6;
+    Bucket buckets[1 << BUCKET_BITS];
+
+    // Fibonacci hashing of the key's address
+    Bucket* bucket_for(const void* key) {
+        uint32_t hash = ((uint32_t)(uintptr_t)key >> 2) * 2654435761u;
+        return &buckets[hash >> (32 - BUCKET_BITS)];
+    }
+
+    /**
+     * Wakes every thread parked on key, returns how many were woken
+     */
+    uint32_t unpark_all(const void* key) {
+        Bucket* bucket = bucket_for(key);
+        IntrusiveQueue<threads::TCB> woken;
+        bucket->lock.lock();
+        bucket->waiters.remove_all([key](threads::TCB* tcb) {
+            return tcb->park_key == key;
+        }, &woken);
+        bucket->lock.unlock();
+
+        uint32_t count = 0;
+        for (threads::TCB* tcb = woken.front(); tcb != nullptr; tcb = tcb->queue_next) {
+            tcb->park_key = nullptr;
+            count++;
+        }
+        scheduler::schedule_all(&woken);
+        return count;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../common/common.h"
+#include "spinlock.h"
+#include "sync_queue.h"
+#include "../threads/threads.h"
+#include "../threads/scheduler.h"
+
+// Global hashed table of wait queues keyed by address, in the style of Linux futexes and WebKit's ParkingLot
+// Primitives built on it only need a word of state, their waiters live here while they block
+namespace parking_lot {
+
+    struct alignas(CACHE_LINE_SIZE) Bucket {
+        Spinlock lock;
+        IntrusiveQueue<threads::TCB> waiters; // Threads parked on any key that hashes here, protected by lock
+    };
+
+    extern Bucket* bucket_for(const void* key);
+
+    /**
+     * Blocks the current thread on key, unless validate() returns false
+     * validate runs under the bucket lock, so an unpark can't slip in between the check and blocking
+     * Returns whether the thread parked
+     */
+    template <typename Validate>
+    bool park(const void* key, Validate validate) {
+        bool was = pit::disable_interrupts();
+        threads::TCB* my_thread = threads::hartstates.mine().current_thread;
+        bool old_preemption = my_thread->setPreemption(false);
+        my_thread->park_hart = smp::me();
+        pit::restore_interrupts(was);
+
+        Bucket* bucket = bucket_for(key);
+        bucket->lock.lock();
+        bool parked = validate();
+        if (parked) {
+            my_thread->park_key = key;
+            threads::wait_on(my_thread, &bucket->waiters, &bucket->lock);
+        } else {
+            bucket->lock.unlock();
+        }
+
+        was = pit::disable_interrupts();
+        my_thread->setPreemption(old_preemption);
+        pit::restore_interrupts(was);
+        return parked;
+    }
+
+    /**
+     * Wakes the longest parked thread on key, on the HART it parked on while its cache is still warm
+     * callback(more) runs under the bucket lock, more tells whether threads are still parked on key
+     * Returns whether a thread was woken
+     */
+    template <typename Callback>
+    bool unpark_one(const void* key, Callback callback) {
+        Bucket* bucket = bucket_for(key);
+        bucket->lock.lock();
+        threads::TCB* woken = bucket->waiters.remove_first([key](threads::TCB* tcb) {
+            return tcb->park_key == key;
+        });
+        bool more = false;
+        for (threads::TCB* tcb = bucket->waiters.front(); tcb != nullptr; tcb = tcb->queue_next) {
+            if (tcb->park_key == key) {
+                more = true;
+                break;
+            }
+        }
+        callback(more);
+        bucket->lock.unlock();
+        if (woken != nullptr) {
+            woken->park_key = nullptr;
+            scheduler::schedule_on(woken->park_hart, woken);
+        }
+        return woken != nullptr;
+    }
+
+    inline bool unpark_one(const void* key) {
+        return unpark_one(key, [](bool more) {});
+    }
+
+    extern uint32_t unpark_all(const void* key);
+};
\ No newline at end of file
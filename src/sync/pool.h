@@ -1,27 +1,43 @@
 #pragma once
 
 #include "../common/common.h"
-#include "sync_queue.h"
-#include "semaphore.h"
+#include "../threads/threads.h"
+#include "magazine.h"
 
-// Resource pool, basically a wrapper for a non-blocking queue
+// Resource pool in front of per-HART magazines, see MagazineCache
+// allocate and free stay on the current HART in the common case, and allocate only waits when every
+// object is in use. flush() hands a HART's cached objects back in whole magazines
 template <typename T>
 class Pool {
-    Semaphore sem;
-    SyncQueue<T> resources;
+    MagazineCache<T> cache;
 public:
-    Pool() : sem(0), resources() {}
+    Pool() : cache() {}
 
+    /**
+     * Returns a free object, yielding to other kthreads until one is available
+     */
     T* allocate() {
-        sem.down();
-        T* val = resources.pop();
+        T* val;
+        while ((val = cache.try_allocate()) == nullptr) {
+            threads::yield();
+        }
         return val;
     }
 
+    /**
+     * Returns a free object, or nullptr if none is available without waiting
+     */
+    T* try_allocate() {
+        return cache.try_allocate();
+    }
+
     void free(T* val) {
         if (val != nullptr) {
-            resources.push(val);
-            sem.up();
+            cache.free(val);
         }
     }
+
+    void flush() {
+        cache.flush();
+    }
 };
\ No newline at end of file
@@ -1,30 +1,186 @@
 #pragma once
 
-#include "semaphore.h"
+#include "atomic.h"
+#include "spinlock.h"
+#include "sync_queue.h"
+#include "shared.h"
+#include "../threads/threads.h"
+#include "../threads/scheduler.h"
 
 template <typename T>
 class Promise {
+    // Callback registered with then(), run once with the value
+    struct Continuation {
+        Continuation* next;
+        virtual void run(const T& value) = 0;
+        virtual ~Continuation() {}
+    };
+
+    template <typename Callback>
+    struct CallbackContinuation : Continuation {
+        Callback callback;
+        CallbackContinuation(Callback callback) : callback(callback) {}
+        void run(const T& value) override {
+            callback(value);
+        }
+    };
+
     T value;
-    Semaphore sem;
+    Atomic<uint32_t> ready;
+    Spinlock lock;
+    IntrusiveQueue<threads::TCB> waiters; // Protected by lock
+    Continuation* continuations; // Protected by lock, most recently registered first
+
+    void wait() {
+        bool was = pit::disable_interrupts();
+        threads::TCB* my_thread = threads::hartstates.mine().current_thread;
+        bool old_preemption = my_thread->setPreemption(false);
+        pit::restore_interrupts(was);
+
+        lock.lock();
+        if (ready.get(MemoryOrder::RELAXED)) {
+            lock.unlock();
+        } else {
+            threads::wait_on(my_thread, &waiters, &lock);
+        }
+
+        was = pit::disable_interrupts();
+        my_thread->setPreemption(old_preemption);
+        pit::restore_interrupts(was);
+    }
+
 public:
-    Promise() : sem(0) {}
+    Promise() : value(), ready(0), lock(), waiters(), continuations(nullptr) {}
+
+    ~Promise() {
+        while (continuations != nullptr) {
+            Continuation* next = continuations->next;
+            delete continuations;
+            continuations = next;
+        }
+    }
+
+    bool is_ready() const {
+        return ready.get(MemoryOrder::ACQUIRE);
+    }
 
     /**
      * Gets the value from a promise
      * Blocks until the value is ready
      */
     T get() {
-        sem.down();
-        sem.up();
+        if (!ready.get(MemoryOrder::ACQUIRE)) {
+            wait();
+        }
         return value;
     }
 
     /**
      * Sets the value of a promise
+     * Wakes every waiter at once and runs continuations on the calling thread, in registration order
      * Undefined if called more than once
      */
     void set(T val) {
+        lock.lock();
+        ASSERT(!ready.get(MemoryOrder::RELAXED));
         value = val;
-        sem.up(); // Signals consumers that the value is ready
+        ready.set(1, MemoryOrder::RELEASE);
+        IntrusiveQueue<threads::TCB> woken = waiters;
+        waiters = IntrusiveQueue<threads::TCB>();
+        Continuation* pending = continuations;
+        continuations = nullptr;
+        lock.unlock();
+
+        scheduler::schedule_all(&woken);
+
+        // Reverse into registration order
+        Continuation* ordered = nullptr;
+        while (pending != nullptr) {
+            Continuation* next = pending->next;
+            pending->next = ordered;
+            ordered = pending;
+            pending = next;
+        }
+        while (ordered != nullptr) {
+            Continuation* next = ordered->next;
+            ordered->run(value);
+            delete ordered;
+            ordered = next;
+        }
+    }
+
+    /**
+     * Runs callback(value) once the value is set
+     * If the value is already set, callback runs immediately on the calling thread, otherwise on the
+     * thread that calls set(). That may be an interrupt handler, so callbacks must not block
+     */
+    template <typename Callback>
+    void then(Callback callback) {
+        lock.lock();
+        if (ready.get(MemoryOrder::RELAXED)) {
+            lock.unlock();
+            callback(value);
+            return;
+        }
+        Continuation* continuation = new CallbackContinuation<Callback>(callback);
+        continuation->next = continuations;
+        continuations = continuation;
+        lock.unlock();
+    }
+};
+
+/**
+ * Returns a promise that is set once every promise in promises is set
+ * It is set to true, unless T is bool and one of the values was false
+ */
+template <typename T>
+SharedPtr<Promise<bool>> when_all(SharedPtr<Promise<T>>* promises, uint32_t count) {
+    struct State {
+        Atomic<uint32_t> remaining;
+        Atomic<uint32_t> failed;
+        SharedPtr<Promise<bool>> result;
+        State(uint32_t count) : remaining(count), failed(0), result(make_shared<Promise<bool>>()) {}
+    };
+    SharedPtr<State> state = make_shared<State>(count);
+    SharedPtr<Promise<bool>> result = state->result;
+    if (count == 0) {
+        result->set(true);
+        return result;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        promises[i]->then([state](const T& value) mutable {
+            if constexpr (__is_same(T, bool)) {
+                if (!value) {
+                    state->failed.set(1, MemoryOrder::RELAXED);
+                }
+            }
+            if (state->remaining.add_fetch(-1, MemoryOrder::ACQ_REL) == 0) {
+                state->result->set(state->failed.get(MemoryOrder::RELAXED) == 0);
+            }
+        });
+    }
+    return result;
+}
+
+/**
+ * Returns a promise that is set to the index of the first promise in promises to be set
+ */
+template <typename T>
+SharedPtr<Promise<uint32_t>> when_any(SharedPtr<Promise<T>>* promises, uint32_t count) {
+    ASSERT(count > 0);
+    struct State {
+        Atomic<uint32_t> claimed;
+        SharedPtr<Promise<uint32_t>> result;
+        State() : claimed(0), result(make_shared<Promise<uint32_t>>()) {}
+    };
+    SharedPtr<State> state = make_shared<State>();
+    SharedPtr<Promise<uint32_t>> result = state->result;
+    for (uint32_t i = 0; i < count; i++) {
+        promises[i]->then([state, i](const T& value) mutable {
+            if (state->claimed.compare_and_swap(0, 1, MemoryOrder::ACQ_REL)) {
+                state->result->set(i);
+            }
+        });
     }
-};
\ No newline at end of file
+    return result;
+}
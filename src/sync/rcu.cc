@@ -0,0 +1,108 @@
+#include "rcu.h"
+
+namespace rcu {
+
+    smp::PerCPU<HartState> harts;
+
+    // Records the current qs_seq of every other online HART, returns the HARTs to wait on
+    static uint32_t snapshot(uint32_t me, uint32_t* seqs) {
+        atomic::fence(); // Unlinks before this are visible before we sample any counter
+        uint32_t mask = 0;
+        for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
+            if (id != me && harts.forCPU(id).online.get(MemoryOrder::ACQUIRE)) {
+                seqs[id] = harts.forCPU(id).qs_seq.get(MemoryOrder::ACQUIRE);
+                mask |= 1 << id;
+            }
+        }
+        return mask;
+    }
+
+    // Whether every HART in mask has passed a quiescent state since seqs was taken
+    static bool elapsed(uint32_t mask, const uint32_t* seqs) {
+        for (uint32_t id = 0; id < smp::MAX_HARTS; id++) {
+            if ((mask & (1 << id)) && harts.forCPU(id).qs_seq.get(MemoryOrder::ACQUIRE) == seqs[id]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Marks the calling HART as running threads, grace periods wait for it from now on
+     */
+    void online() {
+        bool was = pit::disable_interrupts();
+        harts.mine().online.set(1);
+        pit::restore_interrupts(was);
+    }
+
+    /**
+     * Notes that this HART holds no read section
+     * Called from the idle thread, which every context switch passes through
+     */
+    void quiescent_state() {
+        bool was = pit::disable_interrupts();
+        HartState& me = harts.mine();
+        ASSERT(me.nesting == 0);
+        // Full barrier: the read sections before this can't leak past it, and the ones after it
+        // see every unlink that happened before a grace period sampled the old count
+        me.qs_seq.fetch_add(1);
+        pit::restore_interrupts(was);
+    }
+
+    /**
+     * Notes a quiescent state and runs this HART's callbacks whose grace period has ended
+     * Runs on the idle thread, so callbacks must not block
+     */
+    void process_callbacks() {
+        quiescent_state();
+        HartState& me = harts.mine();
+        if (me.wait_batch != nullptr) {
+            if (!elapsed(me.wait_mask, me.wait_snapshot)) {
+                return;
+            }
+            Head* head = me.wait_batch;
+            me.wait_batch = nullptr;
+            while (head != nullptr) {
+                Head* next = head->next;
+                head->func(head);
+                head = next;
+            }
+        }
+        if (me.next_batch != nullptr) {
+            bool was = pit::disable_interrupts();
+            me.wait_batch = me.next_batch;
+            me.next_batch = nullptr;
+            pit::restore_interrupts(was);
+            me.wait_mask = snapshot(smp::me(), me.wait_snapshot);
+        }
+    }
+
+    /**
+     * Blocks until every read section that started before this call has finished
+     * Must not be called inside a read section
+     */
+    void synchronize() {
+        uint32_t seqs[smp::MAX_HARTS];
+        bool was = pit::disable_interrupts();
+        ASSERT(harts.mine().nesting == 0);
+        // No other thread on this HART can be inside a read section while we run
+        uint32_t mask = snapshot(smp::me(), seqs);
+        pit::restore_interrupts(was);
+        while (!elapsed(mask, seqs)) {
+            threads::yield();
+        }
+    }
+
+    /**
+     * Calls func(head) on this HART's idle thread once a grace period has passed
+     */
+    void call_rcu(Head* head, void (*func)(Head* head)) {
+        head->func = func;
+        bool was = pit::disable_interrupts();
+        HartState& me = harts.mine();
+        head->next = me.next_batch;
+        me.next_batch = head;
+        pit::restore_interrupts(was);
+    }
+};
\ No newline at end of file
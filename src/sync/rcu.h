@@ -0,0 +1,303 @@
+#pragma once
+
+#include "../common/common.h"
+#include "../common/hash.h"
+#include "../boot/smp.h"
+#include "../boot/pit.h"
+#include "../threads/threads.h"
+#include "atomic.h"
+#include "spinlock.h"
+
+// Read-copy-update, in the style of classic non-preemptible Linux RCU
+// Readers disable preemption and never block, so a thread in a read section is never switched out.
+// Every context switch passes through the HART's idle thread, which notes a quiescent state, and a
+// grace period has ended once every other online HART has noted one since it began
+// Writers publish with assign(), unlink old versions under their own lock, and free them after a
+// grace period with synchronize() or call_rcu()
+namespace rcu {
+
+    // Deferred callback, embed in the object being retired like Linux's rcu_head
+    struct Head {
+        Head* next;
+        void (*func)(Head* head);
+    };
+
+    struct HartState {
+        Atomic<uint32_t> qs_seq; // Number of quiescent states this HART has passed
+        Atomic<uint32_t> online; // Set once the HART schedules threads, offline HARTs hold no readers
+        uint32_t nesting; // Read section depth on this HART
+        bool saved_preemption; // Preemption of the thread that entered the outermost read section
+        Head* next_batch; // Callbacks queued since wait_batch started waiting
+        Head* wait_batch; // Callbacks waiting for the grace period in wait_snapshot to end
+        uint32_t wait_mask; // HARTs wait_batch is waiting on
+        uint32_t wait_snapshot[smp::MAX_HARTS]; // qs_seq of each HART in wait_mask when wait_batch started
+    };
+
+    extern smp::PerCPU<HartState> harts;
+
+    extern void online();
+    extern void quiescent_state();
+    extern void process_callbacks();
+    extern void synchronize();
+    extern void call_rcu(Head* head, void (*func)(Head* head));
+
+    /**
+     * Enters a read section, sections nest
+     * The thread must not block or yield until the matching read_unlock
+     */
+    inline void read_lock() {
+        bool was = pit::disable_interrupts();
+        HartState& me = harts.mine();
+        if (me.nesting++ == 0) {
+            me.saved_preemption = threads::hartstates.mine().current_thread->setPreemption(false);
+        }
+        pit::restore_interrupts(was);
+    }
+
+    inline void read_unlock() {
+        bool was = pit::disable_interrupts();
+        HartState& me = harts.mine();
+        ASSERT(me.nesting > 0);
+        if (--me.nesting == 0) {
+            threads::hartstates.mine().current_thread->setPreemption(me.saved_preemption);
+        }
+        pit::restore_interrupts(was);
+    }
+
+    /**
+     * Loads an RCU-protected pointer inside a read section
+     * RISC-V keeps loads through the returned pointer ordered after this load by the address dependency
+     */
+    template <typename T>
+    T* dereference(const Atomic<T*>& ptr) {
+        return ptr.get(MemoryOrder::RELAXED);
+    }
+
+    /**
+     * Publishes val to readers, everything written to *val beforehand is visible to them
+     */
+    template <typename T>
+    void assign(Atomic<T*>& ptr, T* val) {
+        ptr.set(val, MemoryOrder::RELEASE);
+    }
+
+    template <typename T>
+    struct Deleter {
+        Head head;
+        T* obj;
+    };
+
+    /**
+     * Deletes obj after a grace period
+     */
+    template <typename T>
+    void retire(T* obj) {
+        Deleter<T>* deleter = new Deleter<T>();
+        deleter->obj = obj;
+        call_rcu(&deleter->head, [](Head* head) {
+            Deleter<T>* deleter = (Deleter<T>*)head;
+            delete deleter->obj;
+            delete deleter;
+        });
+    }
+};
+
+// Singly linked list with lock-free readers
+// Writers are serialized by a spinlock, removed nodes are freed after a grace period
+template <typename T>
+class RCUList {
+    struct Node {
+        rcu::Head head; // First member, so a Head* is its Node*
+        T value;
+        Atomic<Node*> next;
+        Node(const T& value, Node* next) : head(), value(value), next(next) {}
+    };
+
+    Atomic<Node*> first;
+    Spinlock writeLock;
+
+    static void free_node(rcu::Head* head) {
+        delete (Node*)head;
+    }
+
+public:
+    RCUList() : first(nullptr), writeLock() {}
+
+    ~RCUList() {
+        Node* node = first.get(MemoryOrder::RELAXED);
+        while (node != nullptr) {
+            Node* next = node->next.get(MemoryOrder::RELAXED);
+            delete node;
+            node = next;
+        }
+    }
+
+    void push_front(const T& value) {
+        writeLock.lock();
+        Node* node = new Node(value, first.get(MemoryOrder::RELAXED));
+        rcu::assign(first, node);
+        writeLock.unlock();
+    }
+
+    /**
+     * Unlinks the first value matching pred, returns whether one was found
+     */
+    template <typename Pred>
+    bool remove_first(Pred pred) {
+        writeLock.lock();
+        Atomic<Node*>* link = &first;
+        Node* node = link->get(MemoryOrder::RELAXED);
+        while (node != nullptr && !pred((const T&)node->value)) {
+            link = &node->next;
+            node = link->get(MemoryOrder::RELAXED);
+        }
+        if (node != nullptr) {
+            rcu::assign(*link, node->next.get(MemoryOrder::RELAXED));
+        }
+        writeLock.unlock();
+        if (node != nullptr) {
+            rcu::call_rcu(&node->head, free_node);
+        }
+        return node != nullptr;
+    }
+
+    /**
+     * Copies the first value matching pred into out, returns whether one was found
+     */
+    template <typename Pred>
+    bool find(Pred pred, T& out) {
+        rcu::read_lock();
+        Node* node = rcu::dereference(first);
+        while (node != nullptr && !pred((const T&)node->value)) {
+            node = rcu::dereference(node->next);
+        }
+        if (node != nullptr) {
+            out = node->value;
+        }
+        rcu::read_unlock();
+        return node != nullptr;
+    }
+
+    /**
+     * Calls f(value) on every value inside one read section, f must not block
+     */
+    template <typename F>
+    void for_each(F f) {
+        rcu::read_lock();
+        for (Node* node = rcu::dereference(first); node != nullptr; node = rcu::dereference(node->next)) {
+            f((const T&)node->value);
+        }
+        rcu::read_unlock();
+    }
+};
+
+// Hash map with lock-free readers and a fixed number of buckets
+// Updates never modify a published node: put links a new node and retires the one it replaces
+template <typename K, typename V>
+class RCUHashMap {
+    struct Node {
+        rcu::Head head; // First member, so a Head* is its Node*
+        K key;
+        V value;
+        Atomic<Node*> next;
+        Node(const K& key, const V& value, Node* next) : head(), key(key), value(value), next(next) {}
+    };
+
+    Atomic<Node*>* buckets;
+    uint32_t num_buckets; // Power of two
+    Spinlock writeLock;
+
+    static void free_node(rcu::Head* head) {
+        delete (Node*)head;
+    }
+
+    Atomic<Node*>& bucket_for(const K& key) {
+        return buckets[hashing::hash_of(key) & (num_buckets - 1)];
+    }
+
+    // Caller holds writeLock, returns the link pointing at key's node, or at nullptr
+    Atomic<Node*>* link_for(const K& key) {
+        Atomic<Node*>* link = &bucket_for(key);
+        Node* node = link->get(MemoryOrder::RELAXED);
+        while (node != nullptr && !(node->key == key)) {
+            link = &node->next;
+            node = link->get(MemoryOrder::RELAXED);
+        }
+        return link;
+    }
+
+public:
+    RCUHashMap(uint32_t min_buckets) : writeLock() {
+        num_buckets = 1;
+        while (num_buckets < min_buckets) {
+            num_buckets *= 2;
+        }
+        buckets = new Atomic<Node*>[num_buckets];
+    }
+
+    ~RCUHashMap() {
+        for (uint32_t i = 0; i < num_buckets; i++) {
+            Node* node = buckets[i].get(MemoryOrder::RELAXED);
+            while (node != nullptr) {
+                Node* next = node->next.get(MemoryOrder::RELAXED);
+                delete node;
+                node = next;
+            }
+        }
+        delete[] buckets;
+    }
+
+    RCUHashMap(const RCUHashMap&) = delete;
+    RCUHashMap& operator=(const RCUHashMap&) = delete;
+
+    /**
+     * Copies the value for key into value, returns false if the key is not present
+     * Never takes a lock or writes shared memory
+     */
+    bool find(const K& key, V& value) {
+        rcu::read_lock();
+        Node* node = rcu::dereference(bucket_for(key));
+        while (node != nullptr && !(node->key == key)) {
+            node = rcu::dereference(node->next);
+        }
+        if (node != nullptr) {
+            value = node->value;
+        }
+        rcu::read_unlock();
+        return node != nullptr;
+    }
+
+    bool contains(const K& key) {
+        V value;
+        return find(key, value);
+    }
+
+    /**
+     * Inserts key, or replaces its value if it is already present
+     */
+    void put(const K& key, const V& value) {
+        writeLock.lock();
+        Atomic<Node*>* link = link_for(key);
+        Node* old = link->get(MemoryOrder::RELAXED);
+        Node* next = old != nullptr ? old->next.get(MemoryOrder::RELAXED) : nullptr;
+        rcu::assign(*link, new Node(key, value, next));
+        writeLock.unlock();
+        if (old != nullptr) {
+            rcu::call_rcu(&old->head, free_node);
+        }
+    }
+
+    bool remove(const K& key) {
+        writeLock.lock();
+        Atomic<Node*>* link = link_for(key);
+        Node* old = link->get(MemoryOrder::RELAXED);
+        if (old != nullptr) {
+            rcu::assign(*link, old->next.get(MemoryOrder::RELAXED));
+        }
+        writeLock.unlock();
+        if (old != nullptr) {
+            rcu::call_rcu(&old->head, free_node);
+        }
+        return old != nullptr;
+    }
+};
\ No newline at end of file
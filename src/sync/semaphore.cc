@@ -6,6 +6,10 @@ Semaphore::Semaphore(int n) : n(n), lock() {}
 
 // Decrement the integer, if it goes below 0 then block
 void Semaphore::down() {
+#ifdef CONFIG_LOCKSTAT
+    uint64_t wait_start = pit::get_time();
+    bool contended = false;
+#endif
     bool was = pit::disable_interrupts();
     threads::TCB* my_thread = threads::hartstates.mine().current_thread;
     my_thread->setPreemption(false);
@@ -13,20 +17,17 @@ void Semaphore::down() {
     lock.lock();
     n = n - 1;
     if (n < 0) {
-        // Block
-        threads::hartstates.mine().prev_sem = this; // Set the semaphore
-        threads::block(my_thread, threads::hartstates.mine().idle_thread, [] {
-            ASSERT(threads::hartstates.mine().prev_thread != nullptr);
-            ASSERT(threads::hartstates.mine().prev_sem != nullptr);
-            // Add the thread to the semaphore's blocking queue
-            threads::hartstates.mine().prev_sem->blocked_threads.push(threads::hartstates.mine().prev_thread);
-            // Unlock the semaphore spinlock
-            threads::hartstates.mine().prev_sem->lock.unlock();
-            threads::hartstates.mine().prev_sem = nullptr;
-        });
+        // Block, the idle thread queues us and releases the lock
+#ifdef CONFIG_LOCKSTAT
+        contended = true;
+#endif
+        threads::wait_on(my_thread, &blocked_threads, &lock);
     } else {
         lock.unlock();
     }
+#ifdef CONFIG_LOCKSTAT
+    stats.acquired(wait_start, contended);
+#endif
     was = pit::disable_interrupts();
     if (my_thread != threads::hartstates.mine().idle_thread) {
         my_thread->setPreemption(true);
@@ -53,4 +54,31 @@ void Semaphore::up() {
         my_thread->setPreemption(true);
     }
     pit::restore_interrupts(was);
+}
+
+// Performs down() on behalf of each blocked thread in waiters, in order
+// A waiter that would block is moved onto this semaphore's queue, the rest are made runnable
+void Semaphore::requeue_all(IntrusiveQueue<threads::TCB>* waiters) {
+    bool was = pit::disable_interrupts();
+    threads::TCB* my_thread = threads::hartstates.mine().current_thread;
+    my_thread->setPreemption(false);
+    pit::restore_interrupts(was);
+
+    lock.lock();
+    threads::TCB* waiter = waiters->pop();
+    while (waiter != nullptr) {
+        n = n - 1;
+        if (n < 0) {
+            blocked_threads.push(waiter);
+        } else {
+            scheduler::schedule(waiter);
+        }
+        waiter = waiters->pop();
+    }
+    lock.unlock();
+    was = pit::disable_interrupts();
+    if (my_thread != threads::hartstates.mine().idle_thread) {
+        my_thread->setPreemption(true);
+    }
+    pit::restore_interrupts(was);
 }
\ No newline at end of file
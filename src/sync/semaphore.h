@@ -8,8 +8,20 @@ class Semaphore {
     volatile int n;
 public:
     Spinlock lock; // NoInterrupts (SpinlockNoInterrupts may cause issues with the virtio-blk device isr)
-    SyncQueue<threads::TCB> blocked_threads;
+    IntrusiveQueue<threads::TCB> blocked_threads; // Protected by lock
     Semaphore(int n);
     void down();
     void up();
+    void requeue_all(IntrusiveQueue<threads::TCB>* waiters);
+
+    void set_name(const char* name) {
+#ifdef CONFIG_LOCKSTAT
+        stats.name = name;
+#endif
+        (void)name;
+    }
+
+#ifdef CONFIG_LOCKSTAT
+    lockstat::LockStats stats; // A down() counts as contended when it blocks
+#endif
 };
\ No newline at end of file
@@ -0,0 +1 @@
+#include "seqlock.h"
\ No newline at end of file
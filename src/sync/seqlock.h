@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../common/common.h"
+#include "atomic.h"
+#include "spinlock.h"
+
+// Sequence lock for small, read-mostly values
+// Readers never store to shared memory, they retry if a writer ran concurrently
+// Writers are serialized by a spinlock, which also keeps interrupts off on the writing HART
+// so a reader in an interrupt handler can never spin on a half-finished write
+template <typename T>
+class SeqLock {
+    static_assert(__is_trivially_copyable(T), "SeqLock<T> requires a trivially copyable T");
+
+    Atomic<uint32_t> sequence; // Odd while a write is in progress
+    Spinlock writeLock;
+    T value;
+
+    // Copies word by word through volatile pointers so the compiler cannot merge or elide the reads
+    static void copy(T* dst, const volatile T* src) {
+        if constexpr (sizeof(T) % sizeof(uint32_t) == 0) {
+            const volatile uint32_t* s = (const volatile uint32_t*) src;
+            volatile uint32_t* d = (volatile uint32_t*) dst;
+            for (size_t i = 0; i < sizeof(T) / sizeof(uint32_t); i++) {
+                d[i] = s[i];
+            }
+        } else {
+            const volatile uint8_t* s = (const volatile uint8_t*) src;
+            volatile uint8_t* d = (volatile uint8_t*) dst;
+            for (size_t i = 0; i < sizeof(T); i++) {
+                d[i] = s[i];
+            }
+        }
+    }
+
+public:
+    SeqLock(T value = T()) : sequence(0), writeLock(), value(value) {}
+
+    /**
+     * Returns a consistent snapshot of the value
+     * Never blocks the writer, retries while a write is in progress
+     */
+    T read() const {
+        T snapshot;
+        while (true) {
+            uint32_t before = sequence.get(MemoryOrder::ACQUIRE);
+            if (before & 1) {
+                continue; // Writer in progress
+            }
+            copy(&snapshot, &value);
+            atomic::fence_acquire();
+            if (sequence.get(MemoryOrder::RELAXED) == before) {
+                return snapshot;
+            }
+        }
+    }
+
+    /**
+     * Replaces the value
+     */
+    void write(const T& newval) {
+        writeLock.lock();
+        sequence.fetch_add(1, MemoryOrder::RELAXED);
+        atomic::fence_release();
+        copy(&value, &newval);
+        sequence.fetch_add(1, MemoryOrder::RELEASE);
+        writeLock.unlock();
+    }
+
+    /**
+     * Read-modify-write of the value, update is called with a reference to the current value
+     * Concurrent updates are serialized
+     */
+    template <typename Update>
+    void update(Update update) {
+        writeLock.lock();
+        T copied = value;
+        update(copied);
+        sequence.fetch_add(1, MemoryOrder::RELAXED);
+        atomic::fence_release();
+        copy(&value, &copied);
+        sequence.fetch_add(1, MemoryOrder::RELEASE);
+        writeLock.unlock();
+    }
+};
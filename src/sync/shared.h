@@ -1,18 +1,62 @@
 #pragma once
 
 #include "../common/common.h"
+#include "../common/utility.h"
+#include "../heap.h"
 #include "atomic.h"
 
 // Intermediate Control Block
+// shared_count counts SharedPtrs, weak_count counts WeakPtrs plus one for all SharedPtrs together,
+// so copying a SharedPtr only touches shared_count
 template <typename T>
 class ICB {
 public:
     T* value;
     Atomic<uint32_t> shared_count;
-    Atomic<uint32_t> total_count;
-    ICB(T* ptr) : value(ptr), shared_count(1), total_count(1) {}
+    Atomic<uint32_t> weak_count;
+    bool inline_value; // value was built inside this block by make_shared
+    ICB(T* ptr) : value(ptr), shared_count(1), weak_count(1), inline_value(false) {}
+
+    // Called when the last SharedPtr goes away
+    void destroy_value();
+
+    // Called when the last SharedPtr and WeakPtr are gone
+    void destroy();
 };
 
+// Control block and value in one allocation, made by make_shared
+template <typename T>
+class InlineICB : public ICB<T> {
+public:
+    alignas(T) uint8_t storage[sizeof(T)];
+
+    template <typename... Args>
+    InlineICB(Args&&... args) : ICB<T>(nullptr) {
+        this->value = new (storage) T(util::forward<Args>(args)...);
+        this->inline_value = true;
+    }
+};
+
+template <typename T>
+void ICB<T>::destroy_value() {
+    T* val = value;
+    value = nullptr;
+    if (inline_value) {
+        val->~T();
+    } else {
+        delete val;
+    }
+}
+
+template <typename T>
+void ICB<T>::destroy() {
+    if (inline_value) {
+        delete static_cast<InlineICB<T>*>(this);
+    } else {
+        delete this;
+    }
+}
+
 template <typename T>
 class SharedPtr;
 template <typename T>
@@ -21,6 +65,24 @@ class WeakPtr;
 template <typename T>
 class SharedPtr {
     ICB<T>* icb;
+
+    explicit SharedPtr(ICB<T>* icb, bool) : icb(icb) {}
+
+    // Drops this reference, the last SharedPtr destroys the value
+    // Decrements release our writes to the value, the one that reaches zero acquires everyone else's
+    void release() {
+        if (icb != nullptr) {
+            ICB<T>* my_icb = icb;
+            icb = nullptr;
+            if (my_icb->shared_count.add_fetch(-1, MemoryOrder::ACQ_REL) == 0) {
+                my_icb->destroy_value();
+                if (my_icb->weak_count.add_fetch(-1, MemoryOrder::ACQ_REL) == 0) {
+                    my_icb->destroy();
+                }
+            }
+        }
+    }
+
 public:
     SharedPtr() {
         icb = nullptr;
@@ -35,55 +97,59 @@ public:
     }
 
     ~SharedPtr() {
-        if (icb != nullptr) {
-            uint32_t scount = icb->shared_count.get() != 0 ? icb->shared_count.add_fetch(-1) : 0; // TODO: WRONG
-            uint32_t tcount = icb->total_count.get() != 0 ? icb->total_count.add_fetch(-1) : 0; // TODO: WRONG
-            if (scount == 0) {
-                T* val = icb->value;
-                icb->value = nullptr;
-                delete val;
-            }
-            if (tcount == 0) {
-                ICB<T>* my_icb = icb;
-                icb = nullptr;
-                delete my_icb;
-            }
-        }
+        release();
     }
 
     SharedPtr(const SharedPtr& other) {
         if (other.icb == nullptr) {
             this->icb = nullptr;
         } else {
-            other.icb->shared_count.fetch_add(1);
-            other.icb->total_count.fetch_add(1);
+            other.icb->shared_count.fetch_add(1, MemoryOrder::RELAXED);
             this->icb = other.icb;
         }
     }
 
+    SharedPtr(SharedPtr&& other) noexcept : icb(other.icb) {
+        other.icb = nullptr;
+    }
+
     SharedPtr& operator=(const SharedPtr& other) {
-        if (this == &other) {
-            this->icb = other.icb;
-        } else {
-            this->~SharedPtr();
-            if (other.icb == nullptr) {
-                this->icb = nullptr;
-            } else {
-                other.icb->shared_count.fetch_add(1);
-                other.icb->total_count.fetch_add(1);
-                this->icb = other.icb;
+        if (this->icb != other.icb) {
+            if (other.icb != nullptr) {
+                other.icb->shared_count.fetch_add(1, MemoryOrder::RELAXED);
             }
+            release();
+            this->icb = other.icb;
+        }
+        return *this;
+    }
+
+    SharedPtr& operator=(SharedPtr&& other) noexcept {
+        if (this != &other) {
+            release();
+            this->icb = other.icb;
+            other.icb = nullptr;
         }
         return *this;
     }
 
     SharedPtr& operator=(T* other) {
         ASSERT(other == nullptr);
-        this->~SharedPtr();
-        this->icb = nullptr;
+        release();
         return *this;
     }
 
+    T* get() const {
+        return this->icb == nullptr ? nullptr : this->icb->value;
+    }
+
+    T& operator*() const {
+        if (this->icb == nullptr) {
+            PANIC("Tried to dereference a nullptr\n");
+        }
+        return *this->icb->value;
+    }
+
     T* operator->() {
         if (this->icb == nullptr) {
             PANIC("Tried to dereference a nullptr\n");
@@ -98,80 +164,98 @@ public:
         return this->icb->value;
     }
 
-    bool operator==(const SharedPtr& other) {
-        if (this->icb == nullptr && other->icb == nullptr) {
-            return true;
-        }
-        if (this->icb == nullptr && other->icb != nullptr) {
-            return false;
-        }
-        if (this->icb != nullptr && other->icb == nullptr) {
-            return false;
-        }
-        return this->icb->value == other->icb->value;
+    bool operator==(const SharedPtr& other) const {
+        return this->get() == other.get();
     }
-    
-    bool operator==(T* other) {
+
+    bool operator==(T* other) const {
         ASSERT(other == nullptr);
         return this->icb == nullptr;
     }
 
-    bool operator!=(const SharedPtr& other) {
+    bool operator!=(const SharedPtr& other) const {
         return !(this->operator==(other));
     }
 
-    
-    bool operator!=(T* other) {
+    bool operator!=(T* other) const {
         ASSERT(other == nullptr);
         return !(this->operator==(other));
     }
 
-    const bool operator==(const SharedPtr& other) const {
-        if (this->icb == nullptr && other->icb == nullptr) {
-            return true;
-        }
-        if (this->icb == nullptr && other->icb != nullptr) {
-            return false;
-        }
-        if (this->icb != nullptr && other->icb == nullptr) {
-            return false;
-        }
-        return this->icb->value == other->icb->value;
-    }
-
     WeakPtr<T> demote() {
-        this->icb->total_count.fetch_add(1);
+        if (this->icb == nullptr) {
+            return WeakPtr<T>(nullptr);
+        }
+        this->icb->weak_count.fetch_add(1, MemoryOrder::RELAXED);
         return WeakPtr<T>(this->icb);
     }
 
+    template <typename U, typename... Args>
+    friend SharedPtr<U> make_shared(Args&&... args);
+
     friend class WeakPtr<T>;
 };
 
+/**
+ * Builds a T from args and its control block in a single allocation
+ */
+template <typename T, typename... Args>
+SharedPtr<T> make_shared(Args&&... args) {
+    return SharedPtr<T>(new InlineICB<T>(util::forward<Args>(args)...), true);
+}
+
 template <typename T>
 class WeakPtr {
     ICB<T>* icb;
     WeakPtr(ICB<T>* ptr) {
         icb = ptr;
     }
-public:
-    ~WeakPtr() {
+
+    void release() {
         if (icb != nullptr) {
-            uint32_t tcount = icb->total_count.get() != 0 ? icb->total_count.add_fetch(-1) : 0; // TODO: Wrong
-            if (tcount == 0) {
-                ICB<T>* my_icb = icb;
-                icb = nullptr;
-                delete my_icb;
+            ICB<T>* my_icb = icb;
+            icb = nullptr;
+            if (my_icb->weak_count.add_fetch(-1, MemoryOrder::ACQ_REL) == 0) {
+                my_icb->destroy();
             }
         }
     }
+public:
+    ~WeakPtr() {
+        release();
+    }
 
     WeakPtr(const WeakPtr& other) {
-        if (other == nullptr || other->icb == nullptr) {
+        if (other.icb == nullptr) {
             this->icb = nullptr;
         } else {
-            other->icb->total_count.fetch_add(1);
-            this->icb = other->icb;
+            other.icb->weak_count.fetch_add(1, MemoryOrder::RELAXED);
+            this->icb = other.icb;
+        }
+    }
+
+    WeakPtr(WeakPtr&& other) noexcept : icb(other.icb) {
+        other.icb = nullptr;
+    }
+
+    WeakPtr& operator=(const WeakPtr& other) {
+        if (this->icb != other.icb) {
+            if (other.icb != nullptr) {
+                other.icb->weak_count.fetch_add(1, MemoryOrder::RELAXED);
+            }
+            release();
+            this->icb = other.icb;
         }
+        return *this;
+    }
+
+    WeakPtr& operator=(WeakPtr&& other) noexcept {
+        if (this != &other) {
+            release();
+            this->icb = other.icb;
+            other.icb = nullptr;
+        }
+        return *this;
     }
 
     SharedPtr<T> promote() {
@@ -181,20 +265,127 @@ public:
         }
         uint32_t scount = 0;
         while (true) {
-            scount = icb->shared_count.get();
+            scount = icb->shared_count.get(MemoryOrder::RELAXED);
             if (scount == 0) {
                 // Failure
                 return SharedPtr<T>(nullptr);
             }
             // Attempt to increment this counter via CAS
-            if (icb->shared_count.compare_and_swap(scount, scount + 1)) {
+            if (icb->shared_count.compare_and_swap(scount, scount + 1, MemoryOrder::ACQUIRE)) {
                 // It worked!
-                SharedPtr<T> ptr = SharedPtr<T>(nullptr);
-                ptr.icb = icb;
-                return ptr;
+                return SharedPtr<T>(icb, true);
             }
         }
     }
 
     friend class SharedPtr<T>;
-};
\ No newline at end of file
+};
+
+// Base class for objects that carry their own reference count, managed by RefPtr<T>
+// Saves the control block entirely: one allocation, one atomic per copy
+class RefCounted {
+    Atomic<uint32_t> ref_count;
+
+    template <typename T>
+    friend class RefPtr;
+protected:
+    RefCounted() : ref_count(0) {}
+    RefCounted(const RefCounted&) : ref_count(0) {}
+    RefCounted& operator=(const RefCounted&) {
+        return *this;
+    }
+};
+
+// Smart pointer to a T that derives from RefCounted
+template <typename T>
+class RefPtr {
+    T* ptr;
+
+    void retain() {
+        if (ptr != nullptr) {
+            ptr->ref_count.fetch_add(1, MemoryOrder::RELAXED);
+        }
+    }
+
+    void release() {
+        if (ptr != nullptr) {
+            T* my_ptr = ptr;
+            ptr = nullptr;
+            if (my_ptr->ref_count.add_fetch(-1, MemoryOrder::ACQ_REL) == 0) {
+                delete my_ptr;
+            }
+        }
+    }
+public:
+    RefPtr() : ptr(nullptr) {}
+
+    explicit RefPtr(T* ptr) : ptr(ptr) {
+        retain();
+    }
+
+    ~RefPtr() {
+        release();
+    }
+
+    RefPtr(const RefPtr& other) : ptr(other.ptr) {
+        retain();
+    }
+
+    RefPtr(RefPtr&& other) noexcept : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+
+    RefPtr& operator=(const RefPtr& other) {
+        if (this->ptr != other.ptr) {
+            T* old = this->ptr;
+            this->ptr = other.ptr;
+            retain();
+            RefPtr dropped;
+            dropped.ptr = old; // Released when dropped goes out of scope
+        }
+        return *this;
+    }
+
+    RefPtr& operator=(RefPtr&& other) noexcept {
+        if (this != &other) {
+            release();
+            this->ptr = other.ptr;
+            other.ptr = nullptr;
+        }
+        return *this;
+    }
+
+    T* get() const {
+        return ptr;
+    }
+
+    T& operator*() const {
+        if (ptr == nullptr) {
+            PANIC("Tried to dereference a nullptr\n");
+        }
+        return *ptr;
+    }
+
+    T* operator->() const {
+        if (ptr == nullptr) {
+            PANIC("Tried to dereference a nullptr\n");
+        }
+        return ptr;
+    }
+
+    bool operator==(const RefPtr& other) const {
+        return ptr == other.ptr;
+    }
+
+    bool operator!=(const RefPtr& other) const {
+        return ptr != other.ptr;
+    }
+};
+
+/**
+ * Allocates a RefCounted T and returns the first reference to it
+ */
+template <typename T, typename... Args>
+RefPtr<T> make_ref(Args&&... args) {
+    return RefPtr<T>(new T(util::forward<Args>(args)...));
+}
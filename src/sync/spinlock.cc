@@ -4,28 +4,58 @@
 Spinlock::Spinlock() : locked(0), prev_interrupt_state(false) {}
 
 void Spinlock::lock() {
+#ifdef CONFIG_LOCKSTAT
+    uint64_t wait_start = pit::get_time();
+    bool contended = false;
+#endif
     bool was = pit::disable_interrupts();
-    while (!locked.compare_and_swap(0, 1)) {
+    while (!locked.compare_and_swap(0, 1, MemoryOrder::ACQUIRE)) {
+#ifdef CONFIG_LOCKSTAT
+        contended = true;
+#endif
         pit::restore_interrupts(was);
+        while (locked.get(MemoryOrder::RELAXED) != 0) {
+            // Spin on a plain load until the lock looks free, then retry the CAS
+        }
         was = pit::disable_interrupts();
-        // TODO: Do something
     }
     prev_interrupt_state = was;
+#ifdef CONFIG_LOCKSTAT
+    stats.acquired(wait_start, contended);
+#endif
 }
 
 void Spinlock::unlock() {
-    locked.set(0);
+#ifdef CONFIG_LOCKSTAT
+    stats.released();
+#endif
+    locked.set(0, MemoryOrder::RELEASE);
     pit::restore_interrupts(prev_interrupt_state);
 }
 
 SpinlockNoInterrupts::SpinlockNoInterrupts() : locked(0) {}
 
 void SpinlockNoInterrupts::lock() {
-    while (!locked.compare_and_swap(0, 1)) {
-        // TODO: Do something
+#ifdef CONFIG_LOCKSTAT
+    uint64_t wait_start = pit::get_time();
+    bool contended = false;
+#endif
+    while (!locked.compare_and_swap(0, 1, MemoryOrder::ACQUIRE)) {
+#ifdef CONFIG_LOCKSTAT
+        contended = true;
+#endif
+        while (locked.get(MemoryOrder::RELAXED) != 0) {
+            // Spin on a plain load until the lock looks free, then retry the CAS
+        }
     }
+#ifdef CONFIG_LOCKSTAT
+    stats.acquired(wait_start, contended);
+#endif
 }
 
 void SpinlockNoInterrupts::unlock() {
-    locked.set(0);
+#ifdef CONFIG_LOCKSTAT
+    stats.released();
+#endif
+    locked.set(0, MemoryOrder::RELEASE);
 }
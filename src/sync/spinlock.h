@@ -1,6 +1,7 @@
 #pragma once
 
 #include "atomic.h"
+#include "lockstat.h"
 
 class Spinlock {
 public:
@@ -8,9 +9,20 @@ public:
     void lock();
     void unlock();
 
+    // Label for lockstat::dump(), compiled out without CONFIG_LOCKSTAT
+    void set_name(const char* name) {
+#ifdef CONFIG_LOCKSTAT
+        stats.name = name;
+#endif
+        (void)name;
+    }
+
 //private:
     Atomic<int> locked;
     bool prev_interrupt_state;
+#ifdef CONFIG_LOCKSTAT
+    lockstat::LockStats stats;
+#endif
 };
 
 // Does not disable interrupts while holding the lock
@@ -20,6 +32,16 @@ public:
     void lock();
     void unlock();
 
+    void set_name(const char* name) {
+#ifdef CONFIG_LOCKSTAT
+        stats.name = name;
+#endif
+        (void)name;
+    }
+
 //private:
     Atomic<int> locked;
+#ifdef CONFIG_LOCKSTAT
+    lockstat::LockStats stats;
+#endif
 };
\ No newline at end of file
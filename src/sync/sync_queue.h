@@ -37,8 +37,10 @@ public:
 
     T* pop() {
         T* val = nullptr;
+        SyncQueueData<T>* node = nullptr;
         qlock.lock();
         if (this->head != nullptr) {
+            node = head;
             val = head->data;
             head = head->next;
             if (head == nullptr) {
@@ -46,6 +48,128 @@ public:
             }
         }
         qlock.unlock();
+        delete node; // Free outside of the queue lock
         return val;
     }
+};
+
+// Intrusive FIFO queue, T must have a `T* queue_next` member that is nullptr while T is not queued
+// An element can only be on one intrusive queue at a time
+// Never allocates; not synchronized, callers must hold the lock that protects the queue
+template <typename T>
+class IntrusiveQueue {
+private:
+    T* head;
+    T* tail;
+public:
+    IntrusiveQueue() : head(nullptr), tail(nullptr) {}
+
+    bool empty() const {
+        return head == nullptr;
+    }
+
+    T* front() const {
+        return head;
+    }
+
+    void push(T* ptr) {
+        ASSERT(ptr != nullptr);
+        ASSERT(ptr->queue_next == nullptr);
+        if (tail == nullptr) {
+            head = ptr;
+        } else {
+            tail->queue_next = ptr;
+        }
+        tail = ptr;
+    }
+
+    T* pop() {
+        T* val = head;
+        if (val != nullptr) {
+            head = val->queue_next;
+            if (head == nullptr) {
+                tail = nullptr;
+            }
+            val->queue_next = nullptr;
+        }
+        return val;
+    }
+
+    // Removes and returns the first element for which matches(element) is true, nullptr if there is none
+    template <typename Pred>
+    T* remove_first(Pred matches) {
+        T* prev = nullptr;
+        T* curr = head;
+        while (curr != nullptr && !matches(curr)) {
+            prev = curr;
+            curr = curr->queue_next;
+        }
+        if (curr == nullptr) {
+            return nullptr;
+        }
+        if (prev == nullptr) {
+            head = curr->queue_next;
+        } else {
+            prev->queue_next = curr->queue_next;
+        }
+        if (tail == curr) {
+            tail = prev;
+        }
+        curr->queue_next = nullptr;
+        return curr;
+    }
+
+    // Moves every element for which matches(element) is true onto out, keeping their order
+    template <typename Pred>
+    void remove_all(Pred matches, IntrusiveQueue<T>* out) {
+        IntrusiveQueue<T> kept;
+        T* curr = pop();
+        while (curr != nullptr) {
+            if (matches(curr)) {
+                out->push(curr);
+            } else {
+                kept.push(curr);
+            }
+            curr = pop();
+        }
+        *this = kept;
+    }
+};
+
+// Spinlocked intrusive FIFO queue, never allocates
+template <typename T>
+class IntrusiveSyncQueue {
+private:
+    IntrusiveQueue<T> queue;
+    Spinlock qlock;
+public:
+    IntrusiveSyncQueue() : queue(), qlock() {}
+
+    void set_name(const char* name) {
+        qlock.set_name(name);
+    }
+
+    void push(T* ptr) {
+        qlock.lock();
+        queue.push(ptr);
+        qlock.unlock();
+    }
+
+    T* pop() {
+        qlock.lock();
+        T* val = queue.pop();
+        qlock.unlock();
+        return val;
+    }
+
+    // Moves every element of items onto the queue with a single lock acquisition
+    void push_all(IntrusiveQueue<T>* items) {
+        qlock.lock();
+        T* val = items->pop();
+        while (val != nullptr) {
+            queue.push(val);
+            val = items->pop();
+        }
+        qlock.unlock();
+    }
 };
\ No newline at end of file
@@ -24,6 +24,24 @@ public:
         return value;
     }
 
+    // Copies the value for key into value, returns false if the key is not present
+    bool find(K key, V& value) {
+        mapLock.lock();
+        V* found = map.find(key);
+        if (found != nullptr) {
+            value = *found;
+        }
+        mapLock.unlock();
+        return found != nullptr;
+    }
+
+    bool contains(K key) {
+        mapLock.lock();
+        bool found = map.contains(key);
+        mapLock.unlock();
+        return found;
+    }
+
     bool remove(K key) {
         mapLock.lock();
         bool complete = map.remove(key);
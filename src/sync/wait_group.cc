@@ -0,0 +1,27 @@
+#include "wait_group.h"
+#include "parking_lot.h"
+
+void WaitGroup::wait_slow() {
+    while (true) {
+        uint32_t s = state.get(MemoryOrder::ACQUIRE);
+        if ((s & COUNT_MASK) == 0) {
+            return;
+        }
+        if ((s & WAITERS) == 0) {
+            if (!state.compare_and_swap(s, s | WAITERS)) {
+                continue;
+            }
+            s = s | WAITERS;
+        }
+        // Only sleep if nothing changed since we announced ourselves, a done() in between makes us retry
+        parking_lot::park(&state, [this, s] {
+            return state.get(MemoryOrder::RELAXED) == s;
+        });
+    }
+}
+
+// Only uses the address as a key, done() already cleared the waiters bit
+// A thread that starts waiting on a new round in between is woken too and simply parks again
+void WaitGroup::wake_all() {
+    parking_lot::unpark_all(&state);
+}
\ No newline at end of file
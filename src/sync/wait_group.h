@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../common/common.h"
+#include "atomic.h"
+
+// Reusable fork-join counter on one word, like Go's sync.WaitGroup
+// add() before starting work, done() when it finishes, wait() blocks until the count is back to 0
+// Same parking scheme as Latch, but the count may go up again once waiters have been released
+class WaitGroup {
+    static constexpr uint32_t WAITERS = 0x80000000;
+    static constexpr uint32_t COUNT_MASK = ~WAITERS;
+
+    Atomic<uint32_t> state;
+    void wait_slow();
+    void wake_all();
+public:
+    WaitGroup(uint32_t count = 0) : state(count) {}
+
+    void add(uint32_t n = 1) {
+        state.fetch_add(n, MemoryOrder::RELAXED);
+    }
+
+    // Decrement the count, waking all waiters if it reaches 0
+    // The final decrement clears WAITERS in the same step, because a waiter may return and free the
+    // WaitGroup as soon as it sees 0, after which only its address may be used
+    void done() {
+        uint32_t s;
+        while (true) {
+            s = state.get(MemoryOrder::RELAXED);
+            ASSERT((s & COUNT_MASK) != 0);
+            uint32_t next = (s & COUNT_MASK) == 1 ? 0 : s - 1;
+            if (state.compare_and_swap(s, next, MemoryOrder::RELEASE)) {
+                break;
+            }
+        }
+        if ((s & COUNT_MASK) == 1 && (s & WAITERS)) {
+            wake_all();
+        }
+    }
+
+    // Block until the count is 0
+    void wait() {
+        if ((state.get(MemoryOrder::ACQUIRE) & COUNT_MASK) != 0) {
+            wait_slow();
+        }
+    }
+};
+
+static_assert(sizeof(WaitGroup) == 4, "WaitGroup must stay one word");
\ No newline at end of file
@@ -0,0 +1,19 @@
+#include "word_mutex.h"
+#include "parking_lot.h"
+
+void WordMutex::lock_slow() {
+    // Mark the mutex contended, then sleep until we are the one who swaps it away from unlocked
+    uint32_t old_state = state.exchange(2, MemoryOrder::ACQUIRE);
+    while (old_state != 0) {
+        parking_lot::park(&state, [this] {
+            return state.get(MemoryOrder::RELAXED) == 2;
+        });
+        old_state = state.exchange(2, MemoryOrder::ACQUIRE);
+    }
+}
+
+void WordMutex::unlock_slow() {
+    // There may be waiters, release the mutex and wake one of them
+    state.set(0, MemoryOrder::RELEASE);
+    parking_lot::unpark_one(&state);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../common/common.h"
+#include "atomic.h"
+
+// One-word sleeping mutex, waiters park in the parking lot keyed by the state word
+// Uncontended lock and unlock are a single atomic operation
+// Based on "Futexes Are Tricky" by Ulrich Drepper, mutex take 2
+class WordMutex {
+    Atomic<uint32_t> state; // 0 = unlocked, 1 = locked, 2 = locked with possible waiters
+    void lock_slow();
+    void unlock_slow();
+public:
+    WordMutex() : state(0) {}
+
+    void lock() {
+        if (!state.compare_and_swap(0, 1, MemoryOrder::ACQUIRE)) {
+            lock_slow();
+        }
+    }
+
+    void unlock() {
+        if (state.fetch_add(-1, MemoryOrder::RELEASE) != 1) {
+            unlock_slow();
+        }
+    }
+};
+
+static_assert(sizeof(WordMutex) == 4, "WordMutex must stay one word");
\ No newline at end of file
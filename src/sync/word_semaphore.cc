@@ -0,0 +1,32 @@
+#include "word_semaphore.h"
+#include "parking_lot.h"
+
+void WordSemaphore::down_slow() {
+    while (true) {
+        uint32_t s = state.get(MemoryOrder::RELAXED);
+        if ((s & COUNT_MASK) != 0) {
+            if (state.compare_and_swap(s, s - 1, MemoryOrder::ACQUIRE)) {
+                return;
+            }
+            continue;
+        }
+        if ((s & WAITERS) == 0) {
+            if (!state.compare_and_swap(s, s | WAITERS)) {
+                continue;
+            }
+            s = s | WAITERS;
+        }
+        // Only sleep if nothing changed since we announced ourselves, an up() in between makes us retry
+        parking_lot::park(&state, [this, s] {
+            return state.get(MemoryOrder::RELAXED) == s;
+        });
+    }
+}
+
+void WordSemaphore::wake_waiter() {
+    parking_lot::unpark_one(&state, [this](bool more) {
+        if (!more) {
+            state.fetch_and(COUNT_MASK);
+        }
+    });
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../common/common.h"
+#include "atomic.h"
+
+// One-word counting semaphore, waiters park in the parking lot keyed by the state word
+// The top bit records that threads may be parked, so an uncontended up() is a single atomic add
+class WordSemaphore {
+    static constexpr uint32_t WAITERS = 0x80000000;
+    static constexpr uint32_t COUNT_MASK = ~WAITERS;
+
+    Atomic<uint32_t> state;
+    void down_slow();
+    void wake_waiter();
+public:
+    WordSemaphore(uint32_t n = 0) : state(n) {}
+
+    // Decrement the count, if it is 0 then block until it is not
+    void down() {
+        uint32_t s = state.get(MemoryOrder::RELAXED);
+        if ((s & COUNT_MASK) == 0 || !state.compare_and_swap(s, s - 1, MemoryOrder::ACQUIRE)) {
+            down_slow();
+        }
+    }
+
+    void up() {
+        if (state.fetch_add(1, MemoryOrder::RELEASE) & WAITERS) {
+            wake_waiter();
+        }
+    }
+};
+
+static_assert(sizeof(WordSemaphore) == 4, "WordSemaphore must stay one word");
\ No newline at end of file
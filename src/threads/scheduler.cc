@@ -1,8 +1,17 @@
 #include "scheduler.h"
+#include "../sync/mpmc_queue.h"
 
 namespace scheduler {
 
-    SyncQueue<threads::TCB> tcbQueue;
+    IntrusiveSyncQueue<threads::TCB> tcbQueue; // Links through TCB::queue_next, never allocates
+
+    // Lock-free per-HART inboxes for handing a thread to a specific HART
+    constexpr uint32_t INBOX_SIZE = 16;
+    smp::PerCPU<MPMCQueue<threads::TCB*, INBOX_SIZE>> inboxes;
+
+    void init() {
+        tcbQueue.set_name("scheduler");
+    }
 
     // Puts a tcb in a scheduling data structure
     void schedule(threads::TCB* tcb) {
@@ -10,9 +19,25 @@ namespace scheduler {
         tcbQueue.push(tcb);
     }
 
+    // Puts every tcb in tcbs in the scheduling data structure at once, leaves tcbs empty
+    void schedule_all(IntrusiveQueue<threads::TCB>* tcbs) {
+        tcbQueue.push_all(tcbs);
+    }
+
+    // Hands a tcb to a specific HART, falls back to the shared queue if that HART's inbox is full
+    // parking_lot::unpark_one uses this to wake a thread where it parked
+    void schedule_on(uint32_t hart, threads::TCB* tcb) {
+        if (!inboxes.forCPU(hart).try_push(tcb)) {
+            schedule(tcb);
+        }
+    }
+
     // Gets a tcb out of the scheduling data structure
     threads::TCB* next() {
-        // TODO: get TCB
+        threads::TCB* tcb = nullptr;
+        if (inboxes.mine().try_pop(tcb)) {
+            return tcb;
+        }
         return tcbQueue.pop();
     }
 };
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include "../sync/sync_queue.h"
 
 namespace scheduler {
+    extern void init();
     extern void schedule(threads::TCB* tcb);
+    extern void schedule_on(uint32_t hart, threads::TCB* tcb);
+    extern void schedule_all(IntrusiveQueue<threads::TCB>* tcbs);
     extern threads::TCB* next();
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "scheduler.h"
 #include "../boot/pit.h"
 #include "../boot/kernel.h"
+#include "../sync/rcu.h"
 
 namespace threads {
     // We need the attribute because we need the args to be in specific registers
@@ -91,6 +92,7 @@ namespace threads {
                     while (next == nullptr) {
                         ASSERT(hartstates.mine().current_thread->preemptable == false);
                         ASSERT(hartstates.mine().idle_thread->preemptable == false);
+                        rcu::process_callbacks(); // No read section can be open while the idle thread runs
                         next = scheduler::next();
                     }
                     //printf("Exited idle thread on core %d\n", smp::me());
@@ -120,6 +122,22 @@ namespace threads {
         PANIC("Stop returned in thread_entry, a critical failure occurred.\n");
     }
 
+    // Blocks my_thread on a wait queue without allocating
+    // Assumes preemption is disabled for my_thread and lock is held, lock is released once my_thread is queued
+    void wait_on(TCB* my_thread, IntrusiveQueue<TCB>* queue, Spinlock* lock) {
+        hartstates.mine().prev_queue = queue;
+        hartstates.mine().prev_lock = lock;
+        block(my_thread, hartstates.mine().idle_thread, [] {
+            ASSERT(hartstates.mine().prev_thread != nullptr);
+            ASSERT(hartstates.mine().prev_queue != nullptr);
+            ASSERT(hartstates.mine().prev_lock != nullptr);
+            hartstates.mine().prev_queue->push(hartstates.mine().prev_thread);
+            hartstates.mine().prev_lock->unlock();
+            hartstates.mine().prev_queue = nullptr;
+            hartstates.mine().prev_lock = nullptr;
+        });
+    }
+
     // Gets the id of the currently running kthread
     uint32_t getktid() {
         bool was = pit::disable_interrupts();
@@ -1,13 +1,13 @@
 #pragma once
 
 #include "../common/common.h"
+#include "../common/utility.h"
 #include "../heap.h"
 #include "../boot/smp.h"
 #include "../boot/pit.h"
 #include "../sync/atomic.h"
-
-// Forward declaration to avoid circular include (semaphore.h includes this header)
-class Semaphore;
+#include "../sync/spinlock.h"
+#include "../sync/sync_queue.h"
 
 namespace threads {
 
@@ -24,6 +24,10 @@ namespace threads {
         uint32_t tid; // Kernel thread id
         uint32_t sp; // current stack pointer value for this thread
         bool preemptable; // whether this TCB can be preempted or not
+        TCB* queue_next = nullptr; // Intrusive link, a TCB is on at most one run queue or wait queue at a time
+        const void* park_key = nullptr; // Address this TCB is parked on in the parking lot, nullptr otherwise
+        uint32_t park_hart = 0; // HART this TCB last parked on, unpark_one hands it back to that HART
+        void* wait_data = nullptr; // Set by a blocking primitive to describe what this TCB is waiting for
         bool setPreemption(bool preemption) {
             bool oldFlag = preemptable;
             preemptable = preemption;
@@ -40,7 +44,8 @@ namespace threads {
         TCB* idle_thread; // The idle thread associated with a HART
         BlockRequest req; // Request lambda to the idle thread to do work on the current thread's behalf
         TCB* prev_thread; // Normally nullptr, block will set this to the old thread
-        Semaphore* prev_sem; // Normally nullptr, block will set this to an applicable semaphore to manipulate
+        IntrusiveQueue<TCB>* prev_queue; // Normally nullptr, wait_on sets this to the wait queue the old thread goes on
+        Spinlock* prev_lock; // Normally nullptr, wait_on sets this to the lock protecting prev_queue
         TCB* reap_thread; // Normally nullptr, a BlockRequest will set this whenever it wants a thread to be reaped in the idle thread
     };
 
@@ -65,6 +70,7 @@ namespace threads {
         context_switch(&(my_thread->sp), &(next->sp));
     }
 
+    extern void wait_on(TCB* my_thread, IntrusiveQueue<TCB>* queue, Spinlock* lock);
     extern uint32_t getktid();
     extern void yield();
     extern void stop();
@@ -84,8 +90,8 @@ namespace threads {
         void* stack_mem;
 
     public:
-        TCBWithWork(Work work): work(work) {
-            tid = tidCounter.fetch_add(1);
+        TCBWithWork(Work work): work(util::move(work)) {
+            tid = tidCounter.fetch_add(1, MemoryOrder::RELAXED);
             preemptable = false;
             // Allocate a stack from the heap
             stack_mem = heap::malloc(THREAD_STACK_SIZE);
@@ -128,8 +134,8 @@ namespace threads {
         void* stack_mem;
 
     public:
-        TCBWithIdle(Work work): work(work) {
-            tid = tidCounter.fetch_add(1);
+        TCBWithIdle(Work work): work(util::move(work)) {
+            tid = tidCounter.fetch_add(1, MemoryOrder::RELAXED);
             preemptable = false;
             // Allocate a stack from the heap
             stack_mem = heap::malloc(IDLE_STACK_SIZE);
@@ -170,7 +176,7 @@ namespace threads {
     // Creates a new kernel thread
     template <typename Task>
     void kthread(Task task) {
-        TCB* k_thread = new TCBWithWork<Task>(task);
+        TCB* k_thread = new TCBWithWork<Task>(util::move(task));
         kthread_schedule(k_thread);
     }
 }
\ No newline at end of file